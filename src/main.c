@@ -15,12 +15,26 @@ int main(int argc, char **argv) {
 
   gboolean replace = FALSE;
   gboolean show_version = FALSE;
+  gboolean virtual_services = FALSE;
+  gint idle_timeout = 0;
+  gboolean startup_trace = FALSE;
   g_autofree gchar *status_path = NULL;
+  g_autofree gchar *cache_path = NULL;
   const GOptionEntry options[] = {
       {"replace", 'r', 0, G_OPTION_ARG_NONE, &replace,
        _("Replace current daemon"), NULL},
       {"status-path", 0, 0, G_OPTION_ARG_STRING, &status_path,
        _("Path to status file"), "PATH"},
+      {"cache-path", 0, 0, G_OPTION_ARG_STRING, &cache_path,
+       _("Path to status cache"), "PATH"},
+      {"virtual-services", 0, 0, G_OPTION_ARG_NONE, &virtual_services,
+       _("Serve services from the status without an object per service"),
+       NULL},
+      {"idle-timeout", 0, 0, G_OPTION_ARG_INT, &idle_timeout,
+       _("Exit after being idle for this many seconds (0 to never exit)"),
+       "SECONDS"},
+      {"startup-trace", 0, 0, G_OPTION_ARG_NONE, &startup_trace,
+       _("Print the time taken by each startup phase"), NULL},
       {"version", 'v', 0, G_OPTION_ARG_NONE, &show_version,
        _("Show daemon version"), NULL},
       {NULL}};
@@ -40,10 +54,21 @@ int main(int argc, char **argv) {
   if (status_path == NULL) {
     status_path = g_strdup("/var/lib/ubuntu-advantage/status.json");
   }
+  if (cache_path == NULL) {
+    cache_path =
+        g_strdup("/var/lib/ubuntu-advantage-desktop-daemon/status-cache");
+  }
+
+  if (idle_timeout < 0) {
+    g_printerr("Invalid idle timeout %d\n", idle_timeout);
+    return EXIT_FAILURE;
+  }
 
   g_autoptr(GMainLoop) loop = g_main_loop_new(NULL, FALSE);
 
-  g_autoptr(UaDaemon) daemon = ua_daemon_new(replace, status_path);
+  g_autoptr(UaDaemon) daemon =
+      ua_daemon_new(replace, status_path, cache_path, virtual_services,
+                    idle_timeout, startup_trace);
   g_signal_connect(daemon, "quit", G_CALLBACK(quit_cb), loop);
   if (!ua_daemon_start(daemon, &error)) {
     g_printerr("Failed to start daemon: %s\n", error->message);
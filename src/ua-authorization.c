@@ -3,48 +3,72 @@
 
 #include "ua-authorization.h"
 
-// Called when permission is acquired for this action.
-static void permission_acquired_cb(GObject *object, GAsyncResult *result,
+typedef struct {
+  gchar *action_id;
+  PolkitSubject *subject;
+} CheckData;
+
+static void check_data_free(CheckData *data) {
+  g_clear_pointer(&data->action_id, g_free);
+  g_clear_object(&data->subject);
+  g_free(data);
+}
+
+// Called when polkit has checked the authorization.
+static void check_authorization_cb(GObject *object, GAsyncResult *result,
                                    gpointer user_data) {
-  GPermission *permission = G_PERMISSION(object);
   g_autoptr(GTask) task = G_TASK(user_data);
+  CheckData *data = g_task_get_task_data(task);
 
   g_autoptr(GError) error = NULL;
-  if (!g_permission_acquire_finish(permission, result, &error)) {
+  PolkitAuthorizationResult *authorization_result =
+      polkit_authority_check_authorization_finish(POLKIT_AUTHORITY(object),
+                                                  result, &error);
+  if (authorization_result == NULL) {
     g_task_return_error(task, g_steal_pointer(&error));
     return;
   }
 
-  if (!g_permission_get_allowed(permission)) {
-    g_task_return_new_error(
-        task, G_IO_ERROR, G_IO_ERROR_FAILED, "Not allowed to perform %s",
-        polkit_permission_get_action_id(POLKIT_PERMISSION(permission)));
+  gboolean authorized =
+      polkit_authorization_result_get_is_authorized(authorization_result);
+  g_object_unref(authorization_result);
+  if (!authorized) {
+    g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_FAILED,
+                            "Not allowed to perform %s", data->action_id);
     return;
   }
 
   g_task_return_boolean(task, TRUE);
 }
 
-// Called when permission created.
-static void permission_cb(GObject *object, GAsyncResult *result,
-                          gpointer user_data) {
+// Ask [authority] if the subject of [task] can perform its action.
+static void check_authorization(PolkitAuthority *authority, GTask *task) {
+  CheckData *data = g_task_get_task_data(task);
+  polkit_authority_check_authorization(
+      authority, data->subject, data->action_id, NULL,
+      POLKIT_CHECK_AUTHORIZATION_FLAGS_ALLOW_USER_INTERACTION,
+      g_task_get_cancellable(task), check_authorization_cb, task);
+}
+
+// Called when the polkit authority is ready.
+static void authority_cb(GObject *object, GAsyncResult *result,
+                         gpointer user_data) {
   g_autoptr(GTask) task = G_TASK(user_data);
 
   g_autoptr(GError) error = NULL;
-  g_autoptr(GPermission) permission =
-      polkit_permission_new_finish(result, &error);
-  if (permission == NULL) {
+  PolkitAuthority *authority = polkit_authority_get_finish(result, &error);
+  if (authority == NULL) {
     g_task_return_error(task, g_steal_pointer(&error));
     return;
   }
 
-  g_permission_acquire_async(permission, g_task_get_cancellable(task),
-                             permission_acquired_cb, task);
-  g_steal_pointer(&task);
+  check_authorization(authority, g_steal_pointer(&task));
+  g_object_unref(authority);
 }
 
-// Check if authorized to perform action with [action_id].
-void ua_check_authorization(const gchar *action_id,
+// Check if authorized to perform action with [action_id]. The check is made
+// with [authority], or the authority is got first if it is NULL.
+void ua_check_authorization(PolkitAuthority *authority, const gchar *action_id,
                             GDBusMethodInvocation *invocation,
                             GCancellable *cancellable,
                             GAsyncReadyCallback callback,
@@ -52,12 +76,18 @@ void ua_check_authorization(const gchar *action_id,
   g_autoptr(GTask) task =
       g_task_new(NULL, cancellable, callback, callback_data);
 
-  // g_autoptr(PolkitSubject) requires Polkit 0.114
-  PolkitSubject *subject = polkit_system_bus_name_new(
+  CheckData *data = g_new0(CheckData, 1);
+  data->action_id = g_strdup(action_id);
+  data->subject = polkit_system_bus_name_new(
       g_dbus_method_invocation_get_sender(invocation));
-  polkit_permission_new(action_id, subject, cancellable, permission_cb,
-                        g_steal_pointer(&task));
-  g_object_unref(subject);
+  g_task_set_task_data(task, data, (GDestroyNotify)check_data_free);
+
+  if (authority != NULL) {
+    check_authorization(authority, g_steal_pointer(&task));
+  } else {
+    polkit_authority_get_async(cancellable, authority_cb,
+                               g_steal_pointer(&task));
+  }
 }
 
 // Complete request started with ua_check_authorization().
@@ -1,8 +1,9 @@
 #pragma once
 
 #include <gio/gio.h>
+#include <polkit/polkit.h>
 
-void ua_check_authorization(const gchar *action_id,
+void ua_check_authorization(PolkitAuthority *authority, const gchar *action_id,
                             GDBusMethodInvocation *invocation,
                             GCancellable *cancellable,
                             GAsyncReadyCallback callback,
@@ -1,10 +1,13 @@
 #include <gio/gio.h>
+#include <polkit/polkit.h>
 
 #include "config.h"
 #include "ua-authorization.h"
 #include "ua-daemon.h"
-#include "ua-status-monitor.h"
+#include "ua-scheduler.h"
+#include "ua-service-tree.h"
 #include "ua-tool.h"
+#include "ua-status-monitor.h"
 #include "ua-ubuntu-advantage-generated.h"
 
 // These are not in the generated code because gdbus-codegen
@@ -12,15 +15,67 @@
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(UaUbuntuAdvantageManager, g_object_unref)
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(UaUbuntuAdvantageService, g_object_unref)
 
+// Maximum number of removed service objects kept for reuse.
+#define MAX_POOLED_SERVICES 32
+
+// Maximum time to wait for the status file to be reread after a pro command
+// before replying anyway.
+#define STATUS_REFRESH_TIMEOUT_SECONDS 5
+
 struct _UaDaemon {
   GObject parent_instance;
 
   gboolean replace;
+  gboolean virtual_services;
+  gboolean startup_trace;
+  guint owner_id;
+  GCancellable *cancellable;
+  GMainContext *context;
   GDBusConnection *connection;
+  PolkitAuthority *authority;
   GDBusObjectManagerServer *object_manager;
   UaUbuntuAdvantageManager *manager;
   UaStatusMonitor *status_monitor;
-  GPtrArray *services;
+
+  // Exported D-Bus services, keyed by service name.
+  GHashTable *services;
+
+  // Recently removed service objects, keyed by service name, so they can be
+  // exported again if the service reappears. [pool_order] contains the names
+  // with the oldest first.
+  GHashTable *service_pool;
+  GQueue *pool_order;
+
+  // Queued and running pro commands that new requests can share, in the order
+  // they were queued.
+  GQueue *operations;
+  UaScheduler *scheduler;
+
+  // Clients with method calls in progress, keyed by unique bus name.
+  GHashTable *clients;
+
+  // Serves the services from the status snapshot when [virtual_services] is
+  // set, in which case [services] is not used.
+  UaServiceTree *service_tree;
+
+  // Changes from the status monitor not yet applied to the D-Bus objects.
+  gboolean attached_changed;
+  GArray *pending_changes;
+
+  // Seconds without activity before exiting, or 0 to never exit.
+  guint idle_timeout;
+  guint idle_timeout_id;
+
+  // Filter on [connection] that restarts the idle timeout for each incoming
+  // method call, and TRUE while a restart from it is queued.
+  guint filter_id;
+  gint activity_pending;
+
+  // Number of method calls still being processed, including authorization.
+  guint n_active_calls;
+
+  // Time ua_daemon_start() was called.
+  gint64 start_time;
 };
 
 G_DEFINE_TYPE(UaDaemon, ua_daemon, G_TYPE_OBJECT)
@@ -29,9 +84,214 @@ enum { SIGNAL_QUIT, SIGNAL_LAST };
 
 static guint signals[SIGNAL_LAST] = {0};
 
+typedef enum {
+  PENDING_CHANGE_ADD,
+  PENDING_CHANGE_REMOVE,
+  PENDING_CHANGE_UPDATE,
+} PendingChangeType;
+
+// A change to a service, applied when the status monitor emits "changed".
+typedef struct {
+  PendingChangeType type;
+  gchar *name;
+  guint fields;
+} PendingChange;
+
+static void pending_change_clear(PendingChange *change) {
+  g_clear_pointer(&change->name, g_free);
+}
+
+// Print the time since startup when [phase] completes, if tracing startup.
+static void trace_startup(UaDaemon *self, const gchar *phase) {
+  if (!self->startup_trace) {
+    return;
+  }
+
+  gint64 elapsed = g_get_monotonic_time() - self->start_time;
+  g_printerr("startup: %-24s %8.1f ms\n", phase, elapsed / 1000.0);
+}
+
+static void reset_idle_timeout(UaDaemon *self);
+
+// Called when the daemon has been idle for the idle timeout.
+static gboolean idle_timeout_cb(gpointer user_data) {
+  UaDaemon *self = user_data;
+
+  self->idle_timeout_id = 0;
+
+  // Don't exit while clients are waiting for results or commands are still
+  // running, check again later.
+  if (g_hash_table_size(self->clients) > 0 ||
+      !g_queue_is_empty(self->operations)) {
+    reset_idle_timeout(self);
+    return G_SOURCE_REMOVE;
+  }
+
+  g_message("Exiting after %u seconds idle", self->idle_timeout);
+
+  // Release the name first so new requests activate a new daemon rather than
+  // being queued for this one.
+  if (self->owner_id != 0) {
+    g_bus_unown_name(self->owner_id);
+    self->owner_id = 0;
+  }
+  g_signal_emit(self, signals[SIGNAL_QUIT], 0);
+
+  return G_SOURCE_REMOVE;
+}
+
+// Restart the idle timeout, unless calls are still being processed.
+static void reset_idle_timeout(UaDaemon *self) {
+  if (self->idle_timeout_id != 0) {
+    g_source_remove(self->idle_timeout_id);
+    self->idle_timeout_id = 0;
+  }
+
+  if (self->idle_timeout == 0 || self->n_active_calls > 0) {
+    return;
+  }
+  self->idle_timeout_id =
+      g_timeout_add_seconds(self->idle_timeout, idle_timeout_cb, self);
+}
+
+// Mark a method call as being processed, preventing idle exit. The call
+// holds a reference, so the daemon outlives the pro commands and status
+// refreshes that complete it.
+static void hold(UaDaemon *self) {
+  g_object_ref(self);
+  self->n_active_calls++;
+  reset_idle_timeout(self);
+}
+
+// Mark a method call as complete.
+static void release(UaDaemon *self) {
+  g_return_if_fail(self->n_active_calls > 0);
+  self->n_active_calls--;
+  reset_idle_timeout(self);
+  g_object_unref(self);
+}
+
+// Called in the main context after a client has sent a method call.
+static gboolean activity_cb(gpointer user_data) {
+  UaDaemon *self = user_data;
+
+  g_atomic_int_set(&self->activity_pending, FALSE);
+  if (self->connection != NULL) {
+    reset_idle_timeout(self);
+  }
+
+  return G_SOURCE_REMOVE;
+}
+
+// Called in the GDBus worker thread for each message. Every incoming method
+// call counts as activity, including property reads and introspection that
+// never reach our method handlers.
+static GDBusMessage *message_filter_cb(GDBusConnection *connection,
+                                       GDBusMessage *message,
+                                       gboolean incoming, gpointer user_data) {
+  UaDaemon *self = user_data;
+
+  if (incoming &&
+      g_dbus_message_get_message_type(message) ==
+          G_DBUS_MESSAGE_TYPE_METHOD_CALL &&
+      g_atomic_int_compare_and_exchange(&self->activity_pending, FALSE,
+                                        TRUE)) {
+    g_main_context_invoke_full(self->context, G_PRIORITY_DEFAULT, activity_cb,
+                               g_object_ref(self), g_object_unref);
+  }
+
+  return message;
+}
+
+// A client with method calls in progress. Its calls are cancelled if it
+// leaves the bus or calls Cancel().
+typedef struct {
+  UaDaemon *self;
+  gchar *name;
+  guint watch_id;
+  guint n_calls;
+
+  // Triggered to cancel the calls in progress. Replaced once triggered, so
+  // later calls are not affected.
+  GCancellable *cancellable;
+} Client;
+
+static void client_free(Client *client) {
+  g_bus_unwatch_name(client->watch_id);
+  g_clear_pointer(&client->name, g_free);
+  g_clear_object(&client->cancellable);
+  g_free(client);
+}
+
+static void cancel_client(Client *client);
+
+// Called when a client with calls in progress leaves the bus.
+static void client_vanished_cb(GDBusConnection *connection, const gchar *name,
+                               gpointer user_data) {
+  Client *client = user_data;
+  g_debug("Cancelling calls from %s, which left the bus", name);
+  cancel_client(client);
+}
+
+// Track the client that made [invocation] until release_client() is called.
+static Client *hold_client(UaDaemon *self, GDBusMethodInvocation *invocation) {
+  const gchar *sender = g_dbus_method_invocation_get_sender(invocation);
+  Client *client = g_hash_table_lookup(self->clients, sender);
+  if (client == NULL) {
+    client = g_new0(Client, 1);
+    client->self = self;
+    client->name = g_strdup(sender);
+    client->cancellable = g_cancellable_new();
+    client->watch_id = g_bus_watch_name_on_connection(
+        self->connection, sender, G_BUS_NAME_WATCHER_FLAGS_NONE, NULL,
+        client_vanished_cb, client, NULL);
+    g_hash_table_insert(self->clients, client->name, client);
+  }
+  client->n_calls++;
+
+  return client;
+}
+
+// Stop tracking [client] once it has no calls in progress.
+static void client_release(Client *client) {
+  g_return_if_fail(client->n_calls > 0);
+  client->n_calls--;
+  if (client->n_calls == 0) {
+    g_hash_table_remove(client->self->clients, client->name);
+  }
+}
+
+// Release the client that made [invocation], held with hold_client().
+static void release_client(UaDaemon *self, GDBusMethodInvocation *invocation) {
+  Client *client = g_hash_table_lookup(
+      self->clients, g_dbus_method_invocation_get_sender(invocation));
+  g_return_if_fail(client != NULL);
+  client_release(client);
+}
+
+// Get a cancellable that is triggered if the client that made [invocation]
+// leaves the bus or calls Cancel(). The client is tracked until
+// release_client() is called.
+static GCancellable *
+hold_client_cancellable(UaDaemon *self, GDBusMethodInvocation *invocation) {
+  return g_object_ref(hold_client(self, invocation)->cancellable);
+}
+
+// Return the [error] from an authorization check to [invocation].
+static void return_auth_error(GDBusMethodInvocation *invocation,
+                              GError *error) {
+  const gchar *error_name = "com.canonical.UbuntuAdvantage.AuthFailed";
+  if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+    error_name = "com.canonical.UbuntuAdvantage.Cancelled";
+  }
+  g_dbus_method_invocation_return_dbus_error(invocation, error_name,
+                                             error->message);
+}
+
 typedef struct {
   UaDaemon *self;
   GDBusMethodInvocation *invocation;
+  GCancellable *cancellable;
   gchar *token;
 } CallbackData;
 
@@ -40,14 +300,19 @@ static CallbackData *callback_data_new(UaDaemon *self,
                                        const gchar *token) {
   CallbackData *data = g_new0(CallbackData, 1);
   data->self = self;
+  hold(self);
   data->invocation = g_object_ref(invocation);
+  data->cancellable = hold_client_cancellable(self, invocation);
   data->token = g_strdup(token);
 
   return data;
 }
 
 static void callback_data_free(CallbackData *data) {
+  release_client(data->self, data->invocation);
+  release(data->self);
   g_clear_object(&data->invocation);
+  g_clear_object(&data->cancellable);
   g_clear_pointer(&data->token, g_free);
   g_free(data);
 }
@@ -57,44 +322,479 @@ G_DEFINE_AUTOPTR_CLEANUP_FUNC(CallbackData, callback_data_free)
 typedef struct {
   UaDaemon *self;
   GDBusMethodInvocation *invocation;
-  UaUbuntuAdvantageService *service;
+  GCancellable *cancellable;
+  gchar *name;
 } ServiceCallbackData;
 
 static ServiceCallbackData *
 service_callback_data_new(UaDaemon *self, GDBusMethodInvocation *invocation,
-                          UaUbuntuAdvantageService *service) {
+                          const gchar *name) {
   ServiceCallbackData *data = g_new0(ServiceCallbackData, 1);
   data->self = self;
+  hold(self);
   data->invocation = g_object_ref(invocation);
-  data->service = g_object_ref(service);
+  data->cancellable = hold_client_cancellable(self, invocation);
+  data->name = g_strdup(name);
 
   return data;
 }
 
 static void service_callback_data_free(ServiceCallbackData *data) {
+  release_client(data->self, data->invocation);
+  release(data->self);
   g_clear_object(&data->invocation);
-  g_clear_object(&data->service);
+  g_clear_object(&data->cancellable);
+  g_clear_pointer(&data->name, g_free);
   g_free(data);
 }
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(ServiceCallbackData, service_callback_data_free)
 
-// Called when 'pro enable' completes.
-static void enable_cb(GObject *object, GAsyncResult *result,
-                      gpointer user_data) {
-  g_autoptr(ServiceCallbackData) data = user_data;
+// Send any pending property changes now rather than when idle, so clients
+// see them before replies sent after this.
+static void flush_property_changes(UaDaemon *self) {
+  g_dbus_interface_skeleton_flush(G_DBUS_INTERFACE_SKELETON(self->manager));
+
+  GHashTableIter iter;
+  gpointer dbus_service;
+  g_hash_table_iter_init(&iter, self->services);
+  while (g_hash_table_iter_next(&iter, NULL, &dbus_service)) {
+    g_dbus_interface_skeleton_flush(G_DBUS_INTERFACE_SKELETON(dbus_service));
+  }
+}
+
+// Show the result of a successful pro command as the status immediately,
+// rather than waiting for pro to rewrite the status file. [file_serial] is
+// the status file serial from before the command was run.
+static void set_provisional_status(UaDaemon *self, guint file_serial,
+                                   UaStatus *status) {
+  ua_status_monitor_set_provisional_status(self->status_monitor, status,
+                                           file_serial);
+  flush_property_changes(self);
+}
+
+// Show the successful [results] of a batch command as the status of those
+// services.
+static void set_provisional_results(UaDaemon *self, guint file_serial,
+                                    GPtrArray *results,
+                                    const gchar *service_status) {
+  g_autoptr(GPtrArray) names = g_ptr_array_new();
+  for (guint i = 0; i < results->len; i++) {
+    UaServiceResult *r = g_ptr_array_index(results, i);
+    if (r->success) {
+      g_ptr_array_add(names, r->name);
+    }
+  }
+  if (names->len == 0) {
+    return;
+  }
+  g_ptr_array_add(names, NULL);
+
+  UaStatus *status = ua_status_monitor_get_status(self->status_monitor);
+  g_autoptr(UaStatus) new_status = ua_status_copy_with_service_status(
+      status, (const gchar *const *)names->pdata, service_status);
+  set_provisional_status(self, file_serial, new_status);
+}
+
+typedef void (*RefreshFunction)(gpointer user_data);
+
+// A reply waiting for the status file to be reread.
+typedef struct {
+  UaDaemon *self;
+  RefreshFunction callback;
+  gpointer callback_data;
+  guint timeout_id;
+
+  // TRUE once [callback] has been called.
+  gboolean complete;
+} StatusRefresh;
+
+static void finish_refresh(StatusRefresh *refresh) {
+  if (refresh->complete) {
+    return;
+  }
+  refresh->complete = TRUE;
+
+  flush_property_changes(refresh->self);
+  refresh->callback(refresh->callback_data);
+}
+
+// Called when the status file is taking too long to be reread.
+static gboolean refresh_timeout_cb(gpointer user_data) {
+  StatusRefresh *refresh = user_data;
+
+  refresh->timeout_id = 0;
+  g_warning("Timed out waiting for Pro status to be reread");
+  finish_refresh(refresh);
+
+  return G_SOURCE_REMOVE;
+}
+
+// Called when the status file has been reread.
+static void refresh_cb(GObject *object, GAsyncResult *result,
+                       gpointer user_data) {
+  StatusRefresh *refresh = user_data;
+
+  g_autoptr(GError) error = NULL;
+  if (!ua_status_monitor_refresh_finish(UA_STATUS_MONITOR(object), result,
+                                        &error) &&
+      !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+    g_warning("Failed to reread Pro status: %s", error->message);
+  }
+
+  if (refresh->timeout_id != 0) {
+    g_source_remove(refresh->timeout_id);
+    refresh->timeout_id = 0;
+  }
+  finish_refresh(refresh);
+  g_object_unref(refresh->self);
+  g_free(refresh);
+}
+
+// Reread the status file after a pro command has changed it, then call
+// [callback] once the D-Bus objects show the new status. This is used to
+// delay method replies so clients always see the result of their request.
+// If the status file can't be read in time [callback] is called anyway.
+static void refresh_status(UaDaemon *self, RefreshFunction callback,
+                           gpointer callback_data) {
+  StatusRefresh *refresh = g_new0(StatusRefresh, 1);
+  refresh->self = g_object_ref(self);
+  refresh->callback = callback;
+  refresh->callback_data = callback_data;
+  refresh->timeout_id = g_timeout_add_seconds(STATUS_REFRESH_TIMEOUT_SECONDS,
+                                              refresh_timeout_cb, refresh);
+  ua_status_monitor_refresh(self->status_monitor, NULL, refresh_cb, refresh);
+}
+
+// A running pro command. Identical requests made while it runs wait for the
+// same result instead of starting another pro command.
+typedef struct {
+  UaDaemon *self;
+  UaOperationType type;
+
+  // Service being enabled or disabled, or NULL.
+  gchar *service_name;
+
+  // Identifies identical requests, made from the type and argument.
+  gchar *key;
+
+  // Status file serial when the operation was queued.
+  guint file_serial;
+
+  // Authorized method invocations waiting for the result.
+  GPtrArray *invocations;
+
+  // Triggered when no invocations are left waiting for the result.
+  GCancellable *cancellable;
+} Operation;
+
+static Operation *operation_new(UaDaemon *self, UaOperationType type,
+                                const gchar *service_name, const gchar *key) {
+  Operation *op = g_new0(Operation, 1);
+  op->self = self;
+  op->type = type;
+  op->service_name = g_strdup(service_name);
+  op->key = g_strdup(key);
+  op->file_serial = ua_status_monitor_get_file_serial(self->status_monitor);
+  op->invocations = g_ptr_array_new_with_free_func(g_object_unref);
+  op->cancellable = g_cancellable_new();
+  hold(self);
+
+  return op;
+}
+
+static void operation_free(Operation *op) {
+  for (guint i = 0; i < op->invocations->len; i++) {
+    release_client(op->self, g_ptr_array_index(op->invocations, i));
+  }
+  release(op->self);
+  g_clear_pointer(&op->service_name, g_free);
+  g_clear_pointer(&op->key, g_free);
+  g_clear_pointer(&op->invocations, g_ptr_array_unref);
+  g_clear_object(&op->cancellable);
+  g_free(op);
+}
+
+// Show the result of the successful [op] in the status.
+static void set_operation_result(Operation *op) {
+  UaStatus *status = ua_status_monitor_get_status(op->self->status_monitor);
+  const gchar *service_names[] = {op->service_name, NULL};
+  g_autoptr(UaStatus) new_status = NULL;
+  switch (op->type) {
+  case UA_OPERATION_ATTACH:
+    new_status = ua_status_copy_with_attached(status, TRUE);
+    break;
+  case UA_OPERATION_DETACH:
+    new_status = ua_status_copy_with_attached(status, FALSE);
+    break;
+  case UA_OPERATION_ENABLE:
+    new_status =
+        ua_status_copy_with_service_status(status, service_names, "enabled");
+    break;
+  case UA_OPERATION_DISABLE:
+    new_status =
+        ua_status_copy_with_service_status(status, service_names, "disabled");
+    break;
+  case UA_OPERATION_ENABLE_SERVICES:
+  case UA_OPERATION_DISABLE_SERVICES:
+    return;
+  }
+
+  set_provisional_status(op->self, op->file_serial, new_status);
+}
+
+// Reply to the invocations waiting for the successful [op].
+static void operation_reply(gpointer user_data) {
+  g_autoptr(Operation) op = user_data;
+
+  for (guint i = 0; i < op->invocations->len; i++) {
+    GDBusMethodInvocation *invocation = g_ptr_array_index(op->invocations, i);
+    g_dbus_method_invocation_return_value(invocation, g_variant_new("()"));
+  }
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(Operation, operation_free)
+
+// Called when the pro command for an operation completes.
+static void operation_cb(GObject *object, GAsyncResult *result,
+                         gpointer user_data) {
+  g_autoptr(Operation) op = user_data;
+  UaDaemon *self = op->self;
+
+  // Requests from now on start a new command. If [op] was cancelled it has
+  // already been removed.
+  g_queue_remove(self->operations, op);
 
   g_autoptr(GError) error = NULL;
-  if (!ua_enable_finish(result, &error)) {
-    g_autofree gchar *error_message =
-        g_strdup_printf("Failed to enable service: %s", error->message);
-    g_dbus_method_invocation_return_dbus_error(
-        data->invocation, "com.canonical.UbuntuAdvantage.Failed",
-        error_message);
+  if (ua_scheduler_run_finish(UA_SCHEDULER(object), result, &error)) {
+    set_operation_result(op);
+    refresh_status(self, operation_reply, g_steal_pointer(&op));
+    return;
+  }
+
+  const gchar *error_prefix = NULL;
+  switch (op->type) {
+  case UA_OPERATION_ATTACH:
+    error_prefix = "Failed to attach";
+    break;
+  case UA_OPERATION_DETACH:
+    error_prefix = "Failed to detach";
+    break;
+  case UA_OPERATION_ENABLE:
+  case UA_OPERATION_ENABLE_SERVICES:
+    error_prefix = "Failed to enable service";
+    break;
+  case UA_OPERATION_DISABLE:
+  case UA_OPERATION_DISABLE_SERVICES:
+    error_prefix = "Failed to disable service";
+    break;
+  }
+  const gchar *error_name = "com.canonical.UbuntuAdvantage.Failed";
+  if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+    error_name = "com.canonical.UbuntuAdvantage.Cancelled";
+  }
+  g_autofree gchar *error_message =
+      g_strdup_printf("%s: %s", error_prefix, error->message);
+  for (guint i = 0; i < op->invocations->len; i++) {
+    GDBusMethodInvocation *invocation = g_ptr_array_index(op->invocations, i);
+    g_dbus_method_invocation_return_dbus_error(invocation, error_name,
+                                               error_message);
+  }
+}
+
+// Add the unique bus name [name] to [names] if not already present.
+static void add_destination(GPtrArray *names, const gchar *name) {
+  for (guint i = 0; i < names->len; i++) {
+    if (g_strcmp0(g_ptr_array_index(names, i), name) == 0) {
+      return;
+    }
+  }
+  g_ptr_array_add(names, (gpointer)name);
+}
+
+// Get the bus names of the clients waiting for the pro command queued with
+// [cancellable].
+static GPtrArray *get_progress_destinations(UaDaemon *self,
+                                            GCancellable *cancellable) {
+  GPtrArray *names = g_ptr_array_new();
+
+  // Operations shared by several requests have their own cancellable.
+  for (GList *link = self->operations->head; link != NULL;
+       link = link->next) {
+    Operation *op = link->data;
+    if (op->cancellable != cancellable) {
+      continue;
+    }
+    for (guint i = 0; i < op->invocations->len; i++) {
+      GDBusMethodInvocation *invocation = g_ptr_array_index(op->invocations, i);
+      add_destination(names, g_dbus_method_invocation_get_sender(invocation));
+    }
+  }
+
+  // Other commands are queued with the cancellable of the client that
+  // requested them.
+  GHashTableIter iter;
+  g_hash_table_iter_init(&iter, self->clients);
+  Client *client;
+  while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&client)) {
+    if (client->cancellable == cancellable) {
+      add_destination(names, client->name);
+    }
+  }
+
+  return names;
+}
+
+// Called with each line of output from a running pro command, and passes it
+// on to the clients waiting for the command. The output is not broadcast, as
+// it can include account and contract details.
+static void progress_cb(UaDaemon *self, UaOperationType type,
+                        const gchar *const *service_names, const gchar *line,
+                        GCancellable *cancellable) {
+  if (self->connection == NULL || cancellable == NULL) {
     return;
   }
 
-  ua_ubuntu_advantage_service_complete_enable(data->service, data->invocation);
+  const gchar *operation = NULL;
+  switch (type) {
+  case UA_OPERATION_ATTACH:
+    operation = "attach";
+    break;
+  case UA_OPERATION_DETACH:
+    operation = "detach";
+    break;
+  case UA_OPERATION_ENABLE:
+  case UA_OPERATION_ENABLE_SERVICES:
+    operation = "enable";
+    break;
+  case UA_OPERATION_DISABLE:
+  case UA_OPERATION_DISABLE_SERVICES:
+    operation = "disable";
+    break;
+  }
+
+  g_autoptr(GPtrArray) destinations =
+      get_progress_destinations(self, cancellable);
+  for (guint i = 0; i < destinations->len; i++) {
+    g_dbus_connection_emit_signal(
+        self->connection, g_ptr_array_index(destinations, i),
+        "/com/canonical/UbuntuAdvantage/Manager",
+        "com.canonical.UbuntuAdvantage.Manager", "Progress",
+        g_variant_new("(s^ass)", operation, service_names, line), NULL);
+  }
+}
+
+// Returns TRUE if [op] and an operation of [type] on [service_name] undo each
+// other.
+static gboolean operation_conflicts(Operation *op, UaOperationType type,
+                                    const gchar *service_name) {
+  switch (type) {
+  case UA_OPERATION_ATTACH:
+    return op->type == UA_OPERATION_DETACH;
+  case UA_OPERATION_DETACH:
+    return op->type == UA_OPERATION_ATTACH;
+  case UA_OPERATION_ENABLE:
+    return op->type == UA_OPERATION_DISABLE &&
+           g_strcmp0(op->service_name, service_name) == 0;
+  case UA_OPERATION_DISABLE:
+    return op->type == UA_OPERATION_ENABLE &&
+           g_strcmp0(op->service_name, service_name) == 0;
+  case UA_OPERATION_ENABLE_SERVICES:
+  case UA_OPERATION_DISABLE_SERVICES:
+    return FALSE;
+  }
+
+  return FALSE;
+}
+
+// Find a queued or running operation with [key] that a request of [type] on
+// [service_name] can share. An operation queued before one that undoes it
+// can't be shared, as its result would be out of date by the time the
+// request completes.
+static Operation *find_operation(UaDaemon *self, const gchar *key,
+                                 UaOperationType type,
+                                 const gchar *service_name) {
+  for (GList *link = self->operations->tail; link != NULL; link = link->prev) {
+    Operation *op = link->data;
+    if (g_strcmp0(op->key, key) == 0) {
+      return op;
+    }
+    if (operation_conflicts(op, type, service_name)) {
+      return NULL;
+    }
+  }
+
+  return NULL;
+}
+
+// Queue the pro command for [type] with [argument] (a token or service name)
+// to complete the authorized [invocation]. If the same command is already
+// queued or running, [invocation] completes with its result instead.
+static void run_operation(UaDaemon *self, UaOperationType type,
+                          const gchar *argument,
+                          GDBusMethodInvocation *invocation) {
+  g_autofree gchar *key =
+      g_strdup_printf("%d:%s", type, argument != NULL ? argument : "");
+  gboolean is_service_operation =
+      type == UA_OPERATION_ENABLE || type == UA_OPERATION_DISABLE;
+  const gchar *service_name = is_service_operation ? argument : NULL;
+  Operation *op = find_operation(self, key, type, service_name);
+  if (op != NULL) {
+    hold_client(self, invocation);
+    g_ptr_array_add(op->invocations, g_object_ref(invocation));
+    return;
+  }
+
+  op = operation_new(self, type, service_name, key);
+  hold_client(self, invocation);
+  g_ptr_array_add(op->invocations, g_object_ref(invocation));
+  g_queue_push_tail(self->operations, op);
+  ua_scheduler_run(self->scheduler, type, argument, op->cancellable,
+                   operation_cb, op);
+}
+
+// Cancel the calls in progress from [client]. Each completes with
+// com.canonical.UbuntuAdvantage.Cancelled, and pro commands are stopped once
+// no other client is waiting for their result.
+static void cancel_client(Client *client) {
+  UaDaemon *self = client->self;
+
+  // Keep [client] until done, as releasing its calls may free it.
+  client->n_calls++;
+
+  g_autoptr(GCancellable) cancellable = g_steal_pointer(&client->cancellable);
+  client->cancellable = g_cancellable_new();
+
+  GList *link = self->operations->head;
+  while (link != NULL) {
+    GList *next = link->next;
+    Operation *op = link->data;
+    for (guint i = op->invocations->len; i > 0; i--) {
+      GDBusMethodInvocation *invocation =
+          g_ptr_array_index(op->invocations, i - 1);
+      if (g_strcmp0(g_dbus_method_invocation_get_sender(invocation),
+                    client->name) != 0) {
+        continue;
+      }
+
+      g_dbus_method_invocation_return_dbus_error(
+          invocation, "com.canonical.UbuntuAdvantage.Cancelled",
+          "Cancelled by client");
+      client_release(client);
+      g_ptr_array_remove_index(op->invocations, i - 1);
+    }
+
+    if (op->invocations->len == 0) {
+      g_queue_delete_link(self->operations, link);
+      g_cancellable_cancel(op->cancellable);
+    }
+    link = next;
+  }
+
+  // Calls still being authorized, and those not shared with other clients.
+  g_cancellable_cancel(cancellable);
+
+  client_release(client);
 }
 
 // Called when result of checking authorization for service enablement
@@ -105,43 +805,33 @@ static void auth_service_enable_cb(GObject *object, GAsyncResult *result,
 
   g_autoptr(GError) error = NULL;
   if (!ua_check_authorization_finish(result, &error)) {
-    g_dbus_method_invocation_return_dbus_error(
-        data->invocation, "com.canonical.UbuntuAdvantage.AuthFailed",
-        error->message);
+    return_auth_error(data->invocation, error);
     return;
   }
 
-  ua_enable(ua_ubuntu_advantage_service_get_name(data->service), NULL,
-            enable_cb, data);
-  g_steal_pointer(&data);
+  run_operation(data->self, UA_OPERATION_ENABLE, data->name, data->invocation);
+}
+
+// Called when a client requests com.canonical.UbuntuAdvantage.Service.Enable()
+// on the service with [name].
+static gboolean handle_service_enable(UaDaemon *self,
+                                      GDBusMethodInvocation *invocation,
+                                      const gchar *name) {
+  ServiceCallbackData *data =
+      service_callback_data_new(self, invocation, name);
+  ua_check_authorization(self->authority,
+                         "com.canonical.UbuntuAdvantage.enable-service",
+                         invocation, data->cancellable,
+                         auth_service_enable_cb, data);
+  return TRUE;
 }
 
 // Called when a client requests com.canonical.UbuntuAdvantage.Service.Enable().
 static gboolean dbus_service_enable_cb(UaDaemon *self,
                                        GDBusMethodInvocation *invocation,
                                        UaUbuntuAdvantageService *service) {
-  ua_check_authorization("com.canonical.UbuntuAdvantage.enable-service",
-                         invocation, NULL, auth_service_enable_cb,
-                         service_callback_data_new(self, invocation, service));
-  return TRUE;
-}
-
-// Called when 'pro disable' completes.
-static void disable_cb(GObject *object, GAsyncResult *result,
-                       gpointer user_data) {
-  g_autoptr(ServiceCallbackData) data = user_data;
-
-  g_autoptr(GError) error = NULL;
-  if (!ua_disable_finish(result, &error)) {
-    g_autofree gchar *error_message =
-        g_strdup_printf("Failed to disable service: %s", error->message);
-    g_dbus_method_invocation_return_dbus_error(
-        data->invocation, "com.canonical.UbuntuAdvantage.Failed",
-        error_message);
-    return;
-  }
-
-  ua_ubuntu_advantage_service_complete_disable(data->service, data->invocation);
+  return handle_service_enable(self, invocation,
+                               ua_ubuntu_advantage_service_get_name(service));
 }
 
 // Called when result of checking authorization for service disablement
@@ -152,15 +842,25 @@ static void auth_service_disable_cb(GObject *object, GAsyncResult *result,
 
   g_autoptr(GError) error = NULL;
   if (!ua_check_authorization_finish(result, &error)) {
-    g_dbus_method_invocation_return_dbus_error(
-        data->invocation, "com.canonical.UbuntuAdvantage.AuthFailed",
-        error->message);
+    return_auth_error(data->invocation, error);
     return;
   }
 
-  ua_disable(ua_ubuntu_advantage_service_get_name(data->service), NULL,
-             disable_cb, data);
-  g_steal_pointer(&data);
+  run_operation(data->self, UA_OPERATION_DISABLE, data->name, data->invocation);
+}
+
+// Called when a client requests
+// com.canonical.UbuntuAdvantage.Service.Disable() on the service with [name].
+static gboolean handle_service_disable(UaDaemon *self,
+                                       GDBusMethodInvocation *invocation,
+                                       const gchar *name) {
+  ServiceCallbackData *data =
+      service_callback_data_new(self, invocation, name);
+  ua_check_authorization(self->authority,
+                         "com.canonical.UbuntuAdvantage.disable-service",
+                         invocation, data->cancellable,
+                         auth_service_disable_cb, data);
+  return TRUE;
 }
 
 // Called when a client requests
@@ -168,44 +868,116 @@ static void auth_service_disable_cb(GObject *object, GAsyncResult *result,
 static gboolean dbus_service_disable_cb(UaDaemon *self,
                                         GDBusMethodInvocation *invocation,
                                         UaUbuntuAdvantageService *service) {
-  ua_check_authorization("com.canonical.UbuntuAdvantage.disable-service",
-                         invocation, NULL, auth_service_disable_cb,
-                         service_callback_data_new(self, invocation, service));
-  return TRUE;
+  return handle_service_disable(self, invocation,
+                                ua_ubuntu_advantage_service_get_name(service));
 }
 
-// Escape [s] so that it can be used in a D-Bus object path.
-// This implements g_dbus_escape_object_path, which requires glib 2.68
-static gchar *escape_object_path(const gchar *s) {
-  GString *escaped = g_string_new("");
-  for (const gchar *c = s; *c != '\0'; c++) {
-    if (g_ascii_isalnum(*c)) {
-      g_string_append_c(escaped, *c);
-    } else {
-      g_string_append_printf(escaped, "_%02x", *c);
-    }
+// Update [fields] in [dbus_service] from [service].
+static void update_service(UaUbuntuAdvantageService *dbus_service,
+                           UaService *service, guint fields) {
+  if (fields & UA_SERVICE_FIELD_DESCRIPTION) {
+    ua_ubuntu_advantage_service_set_description(
+        dbus_service, ua_service_get_description(service));
+  }
+  if (fields & UA_SERVICE_FIELD_ENTITLED) {
+    ua_ubuntu_advantage_service_set_entitled(dbus_service,
+                                             ua_service_get_entitled(service));
+  }
+  if (fields & UA_SERVICE_FIELD_STATUS) {
+    ua_ubuntu_advantage_service_set_status(dbus_service,
+                                           ua_service_get_status(service));
   }
-  return g_string_free(escaped, FALSE);
 }
 
-// Get the D-Bus object path for a UA service with name [service_name].
-static gchar *get_service_object_path(const gchar *service_name) {
-  g_autofree gchar *escaped_name = escape_object_path(service_name);
-  return g_strdup_printf("/com/canonical/UbuntuAdvantage/Services/%s",
-                         escaped_name);
+// Keep the removed service [object] for the service with [name] for reuse,
+// dropping the oldest pooled object if the pool is full.
+static void pool_service(UaDaemon *self, const gchar *name,
+                         GDBusObjectSkeleton *object) {
+  if (g_hash_table_contains(self->service_pool, name)) {
+    return;
+  }
+
+  if (g_queue_get_length(self->pool_order) >= MAX_POOLED_SERVICES) {
+    g_autofree gchar *oldest_name = g_queue_pop_head(self->pool_order);
+    g_hash_table_remove(self->service_pool, oldest_name);
+  }
+
+  g_queue_push_tail(self->pool_order, g_strdup(name));
+  g_hash_table_insert(self->service_pool, g_strdup(name),
+                      g_object_ref(object));
 }
 
-// Update fields in [dbus_service] from [service].
-static void update_service(UaUbuntuAdvantageService *dbus_service,
-                           UaService *service) {
-  ua_ubuntu_advantage_service_set_name(dbus_service,
-                                       ua_service_get_name(service));
-  ua_ubuntu_advantage_service_set_description(
-      dbus_service, ua_service_get_description(service));
-  ua_ubuntu_advantage_service_set_entitled(dbus_service,
-                                           ua_service_get_entitled(service));
-  ua_ubuntu_advantage_service_set_status(dbus_service,
-                                         ua_service_get_status(service));
+// Take the pooled object for the service with [name], or NULL if none.
+static GDBusObjectSkeleton *revive_service(UaDaemon *self, const gchar *name) {
+  GDBusObjectSkeleton *object = g_hash_table_lookup(self->service_pool, name);
+  if (object == NULL) {
+    return NULL;
+  }
+
+  g_object_ref(object);
+  g_hash_table_remove(self->service_pool, name);
+  GList *link =
+      g_queue_find_custom(self->pool_order, name, (GCompareFunc)g_strcmp0);
+  g_free(link->data);
+  g_queue_delete_link(self->pool_order, link);
+
+  return object;
+}
+
+// Unexport the D-Bus object for the service with [name], keeping it in the
+// pool.
+static void unexport_service(UaDaemon *self, const gchar *name) {
+  g_autofree gchar *object_path = ua_service_tree_get_object_path(name);
+  g_autoptr(GDBusObject) object = g_dbus_object_manager_get_object(
+      G_DBUS_OBJECT_MANAGER(self->object_manager), object_path);
+  if (object != NULL) {
+    pool_service(self, name, G_DBUS_OBJECT_SKELETON(object));
+  }
+  g_dbus_object_manager_server_unexport(self->object_manager, object_path);
+}
+
+// Get the exported D-Bus service with [name].
+static UaUbuntuAdvantageService *find_service(UaDaemon *self,
+                                              const gchar *name) {
+  return g_hash_table_lookup(self->services, name);
+}
+
+// Export a D-Bus object for [service], reusing a pooled object if the
+// service was previously removed.
+static void add_service(UaDaemon *self, UaService *service) {
+  const gchar *service_name = ua_service_get_name(service);
+
+  g_autoptr(GDBusObjectSkeleton) o = revive_service(self, service_name);
+  g_autoptr(UaUbuntuAdvantageService) dbus_service = NULL;
+  if (o != NULL) {
+    dbus_service = UA_UBUNTU_ADVANTAGE_SERVICE(g_dbus_object_get_interface(
+        G_DBUS_OBJECT(o), "com.canonical.UbuntuAdvantage.Service"));
+  } else {
+    g_autofree gchar *object_path =
+        ua_service_tree_get_object_path(service_name);
+    dbus_service = ua_ubuntu_advantage_service_skeleton_new();
+    g_signal_connect_swapped(dbus_service, "handle-enable",
+                             G_CALLBACK(dbus_service_enable_cb), self);
+    g_signal_connect_swapped(dbus_service, "handle-disable",
+                             G_CALLBACK(dbus_service_disable_cb), self);
+    ua_ubuntu_advantage_service_set_name(dbus_service, service_name);
+    o = g_dbus_object_skeleton_new(object_path);
+    g_dbus_object_skeleton_add_interface(
+        o, G_DBUS_INTERFACE_SKELETON(dbus_service));
+  }
+
+  // Not exported yet, so this doesn't emit PropertiesChanged.
+  update_service(dbus_service, service, UA_SERVICE_FIELD_ALL);
+  g_hash_table_insert(self->services, g_strdup(service_name),
+                      g_object_ref(dbus_service));
+  g_dbus_object_manager_server_export(self->object_manager, o);
+}
+
+// Remove the D-Bus object for the service with [name].
+static void remove_service(UaDaemon *self, const gchar *name) {
+  if (g_hash_table_remove(self->services, name)) {
+    unexport_service(self, name);
+  }
 }
 
 // Update D-Bus interface from [status].
@@ -214,75 +986,190 @@ static void update_status(UaDaemon *self, UaStatus *status) {
                                            ua_status_get_attached(status));
 
   // Update existing services or remove them.
-  g_autoptr(GPtrArray) existing_services =
-      g_ptr_array_new_with_free_func(g_object_unref);
-  for (guint i = 0; i < self->services->len; i++) {
-    UaUbuntuAdvantageService *dbus_service =
-        g_ptr_array_index(self->services, i);
-    const gchar *service_name =
-        ua_ubuntu_advantage_service_get_name(dbus_service);
+  GHashTableIter iter;
+  const gchar *service_name;
+  UaUbuntuAdvantageService *dbus_service;
+  g_hash_table_iter_init(&iter, self->services);
+  while (g_hash_table_iter_next(&iter, (gpointer *)&service_name,
+                                (gpointer *)&dbus_service)) {
     UaService *service = ua_status_get_service(status, service_name);
     if (service != NULL) {
-      update_service(dbus_service, service);
-      g_ptr_array_add(existing_services, g_object_ref(dbus_service));
+      update_service(dbus_service, service, UA_SERVICE_FIELD_ALL);
     } else {
-      g_autofree gchar *object_path = get_service_object_path(service_name);
-      g_dbus_object_manager_server_unexport(self->object_manager, object_path);
+      unexport_service(self, service_name);
+      g_hash_table_iter_remove(&iter);
     }
   }
-  g_ptr_array_unref(self->services);
-  self->services = g_steal_pointer(&existing_services);
 
   // Add new services.
-  GPtrArray *services = ua_status_get_services(status);
-  for (guint i = 0; i < services->len; i++) {
-    UaService *service = g_ptr_array_index(services, i);
-    const gchar *service_name = ua_service_get_name(service);
-    g_autofree gchar *object_path = get_service_object_path(service_name);
-
-    if (g_dbus_object_manager_get_object(
-            G_DBUS_OBJECT_MANAGER(self->object_manager), object_path) != NULL) {
+  for (guint i = 0; i < ua_status_get_n_services(status); i++) {
+    UaService *service = ua_status_get_service_by_index(status, i);
+    if (find_service(self, ua_service_get_name(service)) == NULL) {
+      add_service(self, service);
+    }
+  }
+}
+
+// Record a change to the service with [name] to be applied on commit.
+static void add_pending_change(UaDaemon *self, PendingChangeType type,
+                               const gchar *name, guint fields) {
+  PendingChange change = {
+      .type = type, .name = g_strdup(name), .fields = fields};
+  g_array_append_val(self->pending_changes, change);
+}
+
+// Called when the Pro attached state changes.
+static void attached_changed_cb(UaDaemon *self, gboolean attached) {
+  self->attached_changed = TRUE;
+}
+
+// Called when a Pro service becomes available.
+static void service_added_cb(UaDaemon *self, UaService *service) {
+  add_pending_change(self, PENDING_CHANGE_ADD, ua_service_get_name(service),
+                     UA_SERVICE_FIELD_ALL);
+}
+
+// Called when a Pro service is no longer available.
+static void service_removed_cb(UaDaemon *self, UaService *service) {
+  add_pending_change(self, PENDING_CHANGE_REMOVE, ua_service_get_name(service),
+                     0);
+}
+
+// Called when a Pro service changes.
+static void service_changed_cb(UaDaemon *self, UaService *service,
+                               guint changed_fields) {
+  add_pending_change(self, PENDING_CHANGE_UPDATE, ua_service_get_name(service),
+                     changed_fields);
+}
+
+// Notify clients of [change] to the virtual service objects. [service] is the
+// new state of the service, or NULL if it has been removed.
+static void apply_virtual_change(UaDaemon *self, PendingChange *change,
+                                 UaService *service) {
+  switch (change->type) {
+  case PENDING_CHANGE_REMOVE:
+    ua_service_tree_emit_removed(self->service_tree, change->name);
+    break;
+  case PENDING_CHANGE_UPDATE:
+    if (service != NULL) {
+      ua_service_tree_emit_changed(self->service_tree, service,
+                                   change->fields);
+    }
+    break;
+  case PENDING_CHANGE_ADD:
+    if (service != NULL) {
+      ua_service_tree_emit_added(self->service_tree, service);
+    }
+    break;
+  }
+}
+
+// Apply the pending changes of [type] from [status].
+static void apply_pending_changes(UaDaemon *self, UaStatus *status,
+                                  PendingChangeType type, GPtrArray *flush) {
+  for (guint i = 0; i < self->pending_changes->len; i++) {
+    PendingChange *change =
+        &g_array_index(self->pending_changes, PendingChange, i);
+    if (change->type != type) {
       continue;
     }
 
-    g_autoptr(UaUbuntuAdvantageService) dbus_service =
-        ua_ubuntu_advantage_service_skeleton_new();
-    g_ptr_array_add(self->services, g_object_ref(dbus_service));
-    g_signal_connect_swapped(dbus_service, "handle-enable",
-                             G_CALLBACK(dbus_service_enable_cb), self);
-    g_signal_connect_swapped(dbus_service, "handle-disable",
-                             G_CALLBACK(dbus_service_disable_cb), self);
-    update_service(dbus_service, service);
+    UaService *service = ua_status_get_service(status, change->name);
+    if (self->virtual_services) {
+      apply_virtual_change(self, change, service);
+      continue;
+    }
 
-    g_autoptr(GDBusObjectSkeleton) o = g_dbus_object_skeleton_new(object_path);
-    g_dbus_object_skeleton_add_interface(
-        o, G_DBUS_INTERFACE_SKELETON(dbus_service));
-    g_dbus_object_manager_server_export(self->object_manager, o);
+    UaUbuntuAdvantageService *dbus_service = find_service(self, change->name);
+    switch (type) {
+    case PENDING_CHANGE_REMOVE:
+      remove_service(self, change->name);
+      break;
+    case PENDING_CHANGE_UPDATE:
+      if (service != NULL && dbus_service != NULL) {
+        update_service(dbus_service, service, change->fields);
+        g_ptr_array_add(flush, g_object_ref(dbus_service));
+      }
+      break;
+    case PENDING_CHANGE_ADD:
+      if (service != NULL && dbus_service == NULL) {
+        add_service(self, service);
+      }
+      break;
+    }
   }
 }
 
-// Called when the Pro status is changed.
-static void status_changed_cb(UaDaemon *self) {
-  update_status(self, ua_status_monitor_get_status(self->status_monitor));
+// Add the [fields] of [service] to [changed] as D-Bus property values.
+static void add_changed_fields(GVariantBuilder *changed, UaService *service,
+                               guint fields) {
+  g_variant_builder_add(changed, "{s@a{sv}}", ua_service_get_name(service),
+                        ua_service_tree_get_properties(service, fields));
 }
 
-// Called when 'pro attach' completes.
-static void attach_cb(GObject *object, GAsyncResult *result,
-                      gpointer user_data) {
-  g_autoptr(CallbackData) data = user_data;
-  UaDaemon *self = data->self;
+// Emit a StatusChanged signal with the pending changes, so clients can follow
+// the status with a single message per change.
+static void emit_status_changed(UaDaemon *self, UaStatus *status) {
+  GVariantBuilder added, changed;
+  g_variant_builder_init(&added, G_VARIANT_TYPE("a(ssss)"));
+  g_variant_builder_init(&changed, G_VARIANT_TYPE("a{sa{sv}}"));
+  g_autoptr(GPtrArray) removed = g_ptr_array_new();
+  for (guint i = 0; i < self->pending_changes->len; i++) {
+    PendingChange *change =
+        &g_array_index(self->pending_changes, PendingChange, i);
+    UaService *service = ua_status_get_service(status, change->name);
+
+    if (change->type == PENDING_CHANGE_REMOVE) {
+      g_ptr_array_add(removed, change->name);
+    } else if (service == NULL) {
+      continue;
+    } else if (change->type == PENDING_CHANGE_ADD) {
+      g_variant_builder_add(&added, "(ssss)", ua_service_get_name(service),
+                            ua_service_get_description(service),
+                            ua_service_get_entitled(service),
+                            ua_service_get_status(service));
+    } else {
+      add_changed_fields(&changed, service, change->fields);
+    }
+  }
+  g_ptr_array_add(removed, NULL);
+
+  guint64 generation =
+      ua_ubuntu_advantage_manager_get_generation(self->manager) + 1;
+  ua_ubuntu_advantage_manager_set_generation(self->manager, generation);
+  ua_ubuntu_advantage_manager_emit_status_changed(
+      self->manager, generation, ua_status_get_attached(status),
+      g_variant_builder_end(&added), (const gchar *const *)removed->pdata,
+      g_variant_builder_end(&changed));
+}
 
-  g_autoptr(GError) error = NULL;
-  if (!ua_attach_finish(result, &error)) {
-    g_autofree gchar *error_message =
-        g_strdup_printf("Failed to attach: %s", error->message);
-    g_dbus_method_invocation_return_dbus_error(
-        data->invocation, "com.canonical.UbuntuAdvantage.Failed",
-        error_message);
-    return;
+// Called when the status monitor has finished reporting a change. All the
+// changes are applied to the D-Bus objects together: removed services first,
+// then updated services, then added services and finally the attached state.
+// Property changes are then flushed immediately so each changed object sends
+// a single PropertiesChanged signal in the same pass, followed by one
+// StatusChanged signal summarising the change.
+static void status_changed_cb(UaDaemon *self) {
+  UaStatus *status = ua_status_monitor_get_status(self->status_monitor);
+  g_autoptr(GPtrArray) flush = g_ptr_array_new_with_free_func(g_object_unref);
+
+  apply_pending_changes(self, status, PENDING_CHANGE_REMOVE, flush);
+  apply_pending_changes(self, status, PENDING_CHANGE_UPDATE, flush);
+  apply_pending_changes(self, status, PENDING_CHANGE_ADD, flush);
+
+  if (self->attached_changed) {
+    ua_ubuntu_advantage_manager_set_attached(self->manager,
+                                             ua_status_get_attached(status));
+    g_ptr_array_add(flush, g_object_ref(self->manager));
+    self->attached_changed = FALSE;
+  }
+
+  for (guint i = 0; i < flush->len; i++) {
+    g_dbus_interface_skeleton_flush(g_ptr_array_index(flush, i));
   }
 
-  ua_ubuntu_advantage_manager_complete_attach(self->manager, data->invocation);
+  emit_status_changed(self, status);
+  g_array_set_size(self->pending_changes, 0);
 }
 
 // Called when result of checking authorization for attach completes.
@@ -292,90 +1179,535 @@ static void auth_attach_cb(GObject *object, GAsyncResult *result,
 
   g_autoptr(GError) error = NULL;
   if (!ua_check_authorization_finish(result, &error)) {
-    g_dbus_method_invocation_return_dbus_error(
-        data->invocation, "com.canonical.UbuntuAdvantage.AuthFailed",
-        error->message);
+    return_auth_error(data->invocation, error);
     return;
   }
 
-  ua_attach(data->token, NULL, attach_cb, data);
-  g_steal_pointer(&data);
+  run_operation(data->self, UA_OPERATION_ATTACH, data->token, data->invocation);
 }
 
 // Called when a client requests com.canonical.UbuntuAdvantage.Attach().
 static gboolean dbus_attach_cb(UaDaemon *self,
                                GDBusMethodInvocation *invocation,
                                const gchar *token) {
-  ua_check_authorization("com.canonical.UbuntuAdvantage.attach", invocation,
-                         NULL, auth_attach_cb,
-                         callback_data_new(self, invocation, token));
+  CallbackData *data = callback_data_new(self, invocation, token);
+  ua_check_authorization(self->authority,
+                         "com.canonical.UbuntuAdvantage.attach", invocation,
+                         data->cancellable, auth_attach_cb, data);
   return TRUE;
 }
 
-// Called when 'pro detach' completes.
-static void detach_cb(GObject *object, GAsyncResult *result,
-                      gpointer user_data) {
+// Called when result of checking authorization for detach completes.
+static void auth_detach_cb(GObject *object, GAsyncResult *result,
+                           gpointer user_data) {
   g_autoptr(CallbackData) data = user_data;
-  UaDaemon *self = data->self;
 
   g_autoptr(GError) error = NULL;
-  if (!ua_detach_finish(result, &error)) {
-    g_autofree gchar *error_message =
-        g_strdup_printf("Failed to detach: %s", error->message);
-    g_dbus_method_invocation_return_dbus_error(
-        data->invocation, "com.canonical.UbuntuAdvantage.Failed",
-        error_message);
+  if (!ua_check_authorization_finish(result, &error)) {
+    return_auth_error(data->invocation, error);
     return;
   }
 
-  ua_ubuntu_advantage_manager_complete_detach(self->manager, data->invocation);
+  run_operation(data->self, UA_OPERATION_DETACH, NULL, data->invocation);
 }
 
-// Called when result of checking authorization for detach completes.
-static void auth_detach_cb(GObject *object, GAsyncResult *result,
-                           gpointer user_data) {
-  g_autoptr(CallbackData) data = user_data;
+// Called when a client requests com.canonical.UbuntuAdvantage.Detach().
+static gboolean dbus_detach_cb(UaDaemon *self,
+                               GDBusMethodInvocation *invocation) {
+  CallbackData *data = callback_data_new(self, invocation, NULL);
+  ua_check_authorization(self->authority,
+                         "com.canonical.UbuntuAdvantage.detach", invocation,
+                         data->cancellable, auth_detach_cb, data);
+  return TRUE;
+}
+
+typedef struct {
+  UaDaemon *self;
+  GDBusMethodInvocation *invocation;
+  GCancellable *cancellable;
+  UaOperationType type;
+  gchar **service_names;
+  guint file_serial;
+  GPtrArray *results;
+} ServicesCallbackData;
+
+static ServicesCallbackData *
+services_callback_data_new(UaDaemon *self, GDBusMethodInvocation *invocation,
+                           UaOperationType type,
+                           const gchar *const *service_names) {
+  ServicesCallbackData *data = g_new0(ServicesCallbackData, 1);
+  data->self = self;
+  data->invocation = g_object_ref(invocation);
+  data->cancellable = hold_client_cancellable(self, invocation);
+  data->type = type;
+  data->service_names = g_strdupv((gchar **)service_names);
+  data->file_serial = ua_status_monitor_get_file_serial(self->status_monitor);
+  hold(self);
+
+  return data;
+}
+
+static void services_callback_data_free(ServicesCallbackData *data) {
+  release_client(data->self, data->invocation);
+  release(data->self);
+  g_clear_object(&data->invocation);
+  g_clear_object(&data->cancellable);
+  g_clear_pointer(&data->service_names, g_strfreev);
+  g_clear_pointer(&data->results, g_ptr_array_unref);
+  g_free(data);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(ServicesCallbackData,
+                              services_callback_data_free)
+
+// Add a result for service [name].
+static void add_service_result(GPtrArray *results, const gchar *name,
+                               gboolean success, const gchar *message) {
+  UaServiceResult *result = g_new0(UaServiceResult, 1);
+  result->name = g_strdup(name);
+  result->success = success;
+  result->message = g_strdup(message);
+  g_ptr_array_add(results, result);
+}
+
+// Return [results] to [invocation] as an a(sbs) array.
+static void return_service_results(GDBusMethodInvocation *invocation,
+                                   GPtrArray *results) {
+  GVariantBuilder builder;
+  g_variant_builder_init(&builder, G_VARIANT_TYPE("a(sbs)"));
+  for (guint i = 0; i < results->len; i++) {
+    UaServiceResult *r = g_ptr_array_index(results, i);
+    g_variant_builder_add(&builder, "(sbs)", r->name, r->success, r->message);
+  }
+  g_dbus_method_invocation_return_value(invocation,
+                                        g_variant_new("(a(sbs))", &builder));
+}
+
+// Reply with the results of enabling or disabling multiple services.
+static void services_reply(gpointer user_data) {
+  g_autoptr(ServicesCallbackData) data = user_data;
+  return_service_results(data->invocation, data->results);
+}
+
+// Called when 'pro enable' or 'pro disable' completes for multiple services.
+static void services_cb(GObject *object, GAsyncResult *result,
+                        gpointer user_data) {
+  g_autoptr(ServicesCallbackData) data = user_data;
+
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GPtrArray) results =
+      ua_scheduler_run_services_finish(UA_SCHEDULER(object), result, &error);
+  if (results == NULL) {
+    const gchar *action =
+        data->type == UA_OPERATION_ENABLE_SERVICES ? "enable" : "disable";
+    const gchar *error_name = "com.canonical.UbuntuAdvantage.Failed";
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+      error_name = "com.canonical.UbuntuAdvantage.Cancelled";
+    }
+    g_autofree gchar *error_message = g_strdup_printf(
+        "Failed to %s services: %s", action, error->message);
+    g_dbus_method_invocation_return_dbus_error(data->invocation, error_name,
+                                               error_message);
+    return;
+  }
+
+  set_provisional_results(
+      data->self, data->file_serial, results,
+      data->type == UA_OPERATION_ENABLE_SERVICES ? "enabled" : "disabled");
+  data->results = g_steal_pointer(&results);
+  refresh_status(data->self, services_reply, g_steal_pointer(&data));
+}
+
+// Called when result of checking authorization for enabling or disabling
+// multiple services completes.
+static void auth_services_cb(GObject *object, GAsyncResult *result,
+                             gpointer user_data) {
+  g_autoptr(ServicesCallbackData) data = user_data;
 
   g_autoptr(GError) error = NULL;
   if (!ua_check_authorization_finish(result, &error)) {
-    g_dbus_method_invocation_return_dbus_error(
-        data->invocation, "com.canonical.UbuntuAdvantage.AuthFailed",
-        error->message);
+    return_auth_error(data->invocation, error);
     return;
   }
 
-  ua_detach(NULL, detach_cb, g_steal_pointer(&data));
+  ua_scheduler_run_services(
+      data->self->scheduler, data->type,
+      (const gchar *const *)data->service_names, data->cancellable,
+      services_cb, data);
+  g_steal_pointer(&data);
 }
 
-// Called when a client requests com.canonical.UbuntuAdvantage.Detach().
-static gboolean dbus_detach_cb(UaDaemon *self,
+// Authorize with [action_id] then run a single pro command of [type] for
+// [service_names].
+static gboolean handle_services(UaDaemon *self,
+                                GDBusMethodInvocation *invocation,
+                                UaOperationType type, const gchar *action_id,
+                                const gchar *const *service_names) {
+  if (service_names[0] == NULL) {
+    g_dbus_method_invocation_return_value(invocation,
+                                          g_variant_new("(a(sbs))", NULL));
+    return TRUE;
+  }
+
+  ServicesCallbackData *data =
+      services_callback_data_new(self, invocation, type, service_names);
+  ua_check_authorization(self->authority, action_id, invocation,
+                         data->cancellable, auth_services_cb, data);
+  return TRUE;
+}
+
+// Called when a client requests
+// com.canonical.UbuntuAdvantage.Manager.EnableServices().
+static gboolean dbus_enable_services_cb(UaDaemon *self,
+                                        GDBusMethodInvocation *invocation,
+                                        const gchar *const *service_names) {
+  return handle_services(self, invocation, UA_OPERATION_ENABLE_SERVICES,
+                         "com.canonical.UbuntuAdvantage.enable-service",
+                         service_names);
+}
+
+// Called when a client requests
+// com.canonical.UbuntuAdvantage.Manager.DisableServices().
+static gboolean dbus_disable_services_cb(UaDaemon *self,
+                                         GDBusMethodInvocation *invocation,
+                                         const gchar *const *service_names) {
+  return handle_services(self, invocation, UA_OPERATION_DISABLE_SERVICES,
+                         "com.canonical.UbuntuAdvantage.disable-service",
+                         service_names);
+}
+
+typedef struct {
+  UaDaemon *self;
+  GDBusMethodInvocation *invocation;
+  GCancellable *cancellable;
+  gchar **enable_names;
+  gchar **disable_names;
+  gboolean enable_checked;
+  gboolean disable_checked;
+  guint file_serial;
+
+  // Results for each service changed, and the number of pro commands still
+  // running.
+  GPtrArray *results;
+  guint n_pending;
+} DesiredServicesData;
+
+static DesiredServicesData *
+desired_services_data_new(UaDaemon *self, GDBusMethodInvocation *invocation,
+                          GPtrArray *enable_names, GPtrArray *disable_names,
+                          GPtrArray *results) {
+  DesiredServicesData *data = g_new0(DesiredServicesData, 1);
+  data->self = self;
+  data->invocation = g_object_ref(invocation);
+  data->cancellable = hold_client_cancellable(self, invocation);
+  g_ptr_array_add(enable_names, NULL);
+  data->enable_names = g_strdupv((gchar **)enable_names->pdata);
+  g_ptr_array_add(disable_names, NULL);
+  data->disable_names = g_strdupv((gchar **)disable_names->pdata);
+  data->results = g_ptr_array_ref(results);
+  data->file_serial = ua_status_monitor_get_file_serial(self->status_monitor);
+  hold(self);
+
+  return data;
+}
+
+static void desired_services_data_free(DesiredServicesData *data) {
+  release_client(data->self, data->invocation);
+  release(data->self);
+  g_clear_object(&data->invocation);
+  g_clear_object(&data->cancellable);
+  g_clear_pointer(&data->enable_names, g_strfreev);
+  g_clear_pointer(&data->disable_names, g_strfreev);
+  g_clear_pointer(&data->results, g_ptr_array_unref);
+  g_free(data);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(DesiredServicesData, desired_services_data_free)
+
+// Reply with the results of SetDesiredServices().
+static void desired_services_reply(gpointer user_data) {
+  g_autoptr(DesiredServicesData) data = user_data;
+  return_service_results(data->invocation, data->results);
+}
+
+// Called when one of the pro commands for SetDesiredServices() completes,
+// which sets [names] to [service_status]. If the command failed entirely,
+// each of [names] is reported as failed.
+static void desired_services_complete(DesiredServicesData *data,
+                                      GAsyncResult *result,
+                                      const gchar *const *names,
+                                      const gchar *service_status) {
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GPtrArray) results = ua_scheduler_run_services_finish(
+      data->self->scheduler, result, &error);
+  if (results != NULL) {
+    set_provisional_results(data->self, data->file_serial, results,
+                            service_status);
+    for (guint i = 0; i < results->len; i++) {
+      UaServiceResult *r = g_ptr_array_index(results, i);
+      add_service_result(data->results, r->name, r->success, r->message);
+    }
+  } else {
+    for (const gchar *const *name = names; *name != NULL; name++) {
+      add_service_result(data->results, *name, FALSE, error->message);
+    }
+  }
+
+  data->n_pending--;
+  if (data->n_pending > 0) {
+    return;
+  }
+
+  refresh_status(data->self, desired_services_reply, data);
+}
+
+// Called when 'pro disable' completes for SetDesiredServices().
+static void desired_disable_cb(GObject *object, GAsyncResult *result,
+                               gpointer user_data) {
+  DesiredServicesData *data = user_data;
+  desired_services_complete(
+      data, result, (const gchar *const *)data->disable_names, "disabled");
+}
+
+// Called when 'pro enable' completes for SetDesiredServices().
+static void desired_enable_cb(GObject *object, GAsyncResult *result,
+                              gpointer user_data) {
+  DesiredServicesData *data = user_data;
+  desired_services_complete(
+      data, result, (const gchar *const *)data->enable_names, "enabled");
+}
+
+static void auth_desired_services_cb(GObject *object, GAsyncResult *result,
+                                     gpointer user_data);
+
+// Check the next authorization required for SetDesiredServices(), then queue
+// the pro commands once all are granted. Disabling is run first so services
+// that conflict with those being enabled are out of the way.
+static void desired_services_next(DesiredServicesData *data) {
+  if (!data->disable_checked && data->disable_names[0] != NULL) {
+    data->disable_checked = TRUE;
+    ua_check_authorization(data->self->authority,
+                           "com.canonical.UbuntuAdvantage.disable-service",
+                           data->invocation, data->cancellable,
+                           auth_desired_services_cb, data);
+    return;
+  }
+  if (!data->enable_checked && data->enable_names[0] != NULL) {
+    data->enable_checked = TRUE;
+    ua_check_authorization(data->self->authority,
+                           "com.canonical.UbuntuAdvantage.enable-service",
+                           data->invocation, data->cancellable,
+                           auth_desired_services_cb, data);
+    return;
+  }
+
+  if (data->disable_names[0] != NULL) {
+    data->n_pending++;
+    ua_scheduler_run_services(data->self->scheduler,
+                              UA_OPERATION_DISABLE_SERVICES,
+                              (const gchar *const *)data->disable_names,
+                              data->cancellable, desired_disable_cb, data);
+  }
+  if (data->enable_names[0] != NULL) {
+    data->n_pending++;
+    ua_scheduler_run_services(data->self->scheduler,
+                              UA_OPERATION_ENABLE_SERVICES,
+                              (const gchar *const *)data->enable_names,
+                              data->cancellable, desired_enable_cb, data);
+  }
+}
+
+// Called when result of checking authorization for SetDesiredServices()
+// completes.
+static void auth_desired_services_cb(GObject *object, GAsyncResult *result,
+                                     gpointer user_data) {
+  g_autoptr(DesiredServicesData) data = user_data;
+
+  g_autoptr(GError) error = NULL;
+  if (!ua_check_authorization_finish(result, &error)) {
+    return_auth_error(data->invocation, error);
+    return;
+  }
+
+  desired_services_next(g_steal_pointer(&data));
+}
+
+// Called when a client requests
+// com.canonical.UbuntuAdvantage.Manager.SetDesiredServices(). The services
+// that differ from [service_names] in the current status are enabled or
+// disabled; if none do the call completes without authorization.
+static gboolean
+dbus_set_desired_services_cb(UaDaemon *self, GDBusMethodInvocation *invocation,
+                             const gchar *const *service_names) {
+  UaStatus *status = ua_status_monitor_get_status(self->status_monitor);
+  g_autoptr(GHashTable) desired = g_hash_table_new(g_str_hash, g_str_equal);
+  g_autoptr(GPtrArray) results =
+      g_ptr_array_new_with_free_func((GDestroyNotify)ua_service_result_free);
+  for (const gchar *const *name = service_names; *name != NULL; name++) {
+    if (ua_status_get_service(status, *name) == NULL) {
+      add_service_result(results, *name, FALSE, "Unknown service");
+      continue;
+    }
+    g_hash_table_add(desired, (gpointer)*name);
+  }
+
+  g_autoptr(GPtrArray) enable_names = g_ptr_array_new();
+  g_autoptr(GPtrArray) disable_names = g_ptr_array_new();
+  for (guint i = 0; i < ua_status_get_n_services(status); i++) {
+    UaService *service = ua_status_get_service_by_index(status, i);
+    const gchar *name = ua_service_get_name(service);
+    gboolean enabled =
+        ua_service_get_state(service) == UA_SERVICE_STATE_ENABLED;
+    gboolean want_enabled = g_hash_table_contains(desired, name);
+    if (want_enabled && !enabled) {
+      g_ptr_array_add(enable_names, (gpointer)name);
+    } else if (!want_enabled && enabled) {
+      g_ptr_array_add(disable_names, (gpointer)name);
+    }
+  }
+
+  if (enable_names->len == 0 && disable_names->len == 0) {
+    return_service_results(invocation, results);
+    reset_idle_timeout(self);
+    return TRUE;
+  }
+
+  desired_services_next(desired_services_data_new(
+      self, invocation, enable_names, disable_names, results));
+  return TRUE;
+}
+
+// Called when a client requests com.canonical.UbuntuAdvantage.Manager.Cancel().
+// The calls the client has in progress are cancelled, and pro commands that
+// no other client is waiting for are stopped.
+static gboolean dbus_cancel_cb(UaDaemon *self,
                                GDBusMethodInvocation *invocation) {
-  ua_check_authorization("com.canonical.UbuntuAdvantage.detach", invocation,
-                         NULL, auth_detach_cb,
-                         callback_data_new(self, invocation, NULL));
+  Client *client = g_hash_table_lookup(
+      self->clients, g_dbus_method_invocation_get_sender(invocation));
+  if (client != NULL) {
+    cancel_client(client);
+  }
+
+  ua_ubuntu_advantage_manager_complete_cancel(self->manager, invocation);
+  reset_idle_timeout(self);
   return TRUE;
 }
 
-// Called when the system bus is acquired.
-static void bus_acquired_cb(GDBusConnection *connection, const gchar *name,
-                            gpointer user_data) {
-  UaDaemon *self = user_data;
+// Returns TRUE if [value] matches the string [filter] entry named [key].
+static gboolean matches_filter(GVariantDict *filter, const gchar *key,
+                               const gchar *value) {
+  const gchar *filter_value;
+  if (!g_variant_dict_lookup(filter, key, "&s", &filter_value)) {
+    return TRUE;
+  }
+  return g_strcmp0(value, filter_value) == 0;
+}
 
-  self->connection = g_object_ref(connection);
-  g_dbus_object_manager_server_set_connection(self->object_manager, connection);
+// Called when a client requests com.canonical.UbuntuAdvantage.GetServices().
+// The services are read from the current status snapshot, optionally only
+// those with the "entitled" and "status" values in [filter].
+static gboolean dbus_get_services_cb(UaDaemon *self,
+                                     GDBusMethodInvocation *invocation,
+                                     GVariant *filter) {
+  g_autoptr(GVariantDict) filter_dict = g_variant_dict_new(filter);
+
+  GVariantIter iter;
+  const gchar *key;
+  GVariant *next_value;
+  g_variant_iter_init(&iter, filter);
+  while (g_variant_iter_next(&iter, "{&sv}", &key, &next_value)) {
+    g_autoptr(GVariant) value = next_value;
+    gboolean valid_key =
+        g_strcmp0(key, "entitled") == 0 || g_strcmp0(key, "status") == 0;
+    if (!valid_key || !g_variant_is_of_type(value, G_VARIANT_TYPE_STRING)) {
+      g_dbus_method_invocation_return_error(
+          invocation, G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+          "Unsupported service filter '%s'", key);
+      return TRUE;
+    }
+  }
 
-  g_autoptr(GDBusObjectSkeleton) o =
-      g_dbus_object_skeleton_new("/com/canonical/UbuntuAdvantage/Manager");
-  g_dbus_object_skeleton_add_interface(
-      o, G_DBUS_INTERFACE_SKELETON(self->manager));
+  UaStatus *status = ua_status_monitor_get_status(self->status_monitor);
+  GVariantBuilder services;
+  g_variant_builder_init(&services, G_VARIANT_TYPE("a(ssss)"));
+  for (guint i = 0; i < ua_status_get_n_services(status); i++) {
+    UaService *service = ua_status_get_service_by_index(status, i);
+    const gchar *entitled = ua_service_get_entitled(service);
+    const gchar *service_status = ua_service_get_status(service);
+    if (!matches_filter(filter_dict, "entitled", entitled) ||
+        !matches_filter(filter_dict, "status", service_status)) {
+      continue;
+    }
+
+    g_variant_builder_add(&services, "(ssss)", ua_service_get_name(service),
+                          ua_service_get_description(service), entitled,
+                          service_status);
+  }
+
+  ua_ubuntu_advantage_manager_complete_get_services(
+      self->manager, invocation, g_variant_builder_end(&services));
+  reset_idle_timeout(self);
+  return TRUE;
+}
+
+// Export the manager directly and serve the services from the status snapshot
+// instead of exporting an object for each service.
+static void export_virtual_services(UaDaemon *self) {
+  UaStatus *status = ua_status_monitor_get_status(self->status_monitor);
+  ua_ubuntu_advantage_manager_set_attached(self->manager,
+                                           ua_status_get_attached(status));
+
+  self->service_tree =
+      ua_service_tree_new(self->status_monitor, self->manager);
+  g_signal_connect_swapped(self->service_tree, "handle-enable",
+                           G_CALLBACK(handle_service_enable), self);
+  g_signal_connect_swapped(self->service_tree, "handle-disable",
+                           G_CALLBACK(handle_service_disable), self);
+
+  g_autoptr(GError) error = NULL;
+  if (!ua_service_tree_export(self->service_tree, self->connection, &error) ||
+      !g_dbus_interface_skeleton_export(
+          G_DBUS_INTERFACE_SKELETON(self->manager), self->connection,
+          "/com/canonical/UbuntuAdvantage/Manager", &error)) {
+    g_warning("Failed to export D-Bus objects: %s", error->message);
+  }
+}
 
+// Export the D-Bus objects on the system bus from the current status.
+static void export_objects(UaDaemon *self) {
+  g_signal_connect_swapped(self->status_monitor, "attached-changed",
+                           G_CALLBACK(attached_changed_cb), self);
+  g_signal_connect_swapped(self->status_monitor, "service-added",
+                           G_CALLBACK(service_added_cb), self);
+  g_signal_connect_swapped(self->status_monitor, "service-removed",
+                           G_CALLBACK(service_removed_cb), self);
+  g_signal_connect_swapped(self->status_monitor, "service-changed",
+                           G_CALLBACK(service_changed_cb), self);
   g_signal_connect_swapped(self->status_monitor, "changed",
                            G_CALLBACK(status_changed_cb), self);
-  status_changed_cb(self);
 
+  if (self->virtual_services) {
+    export_virtual_services(self);
+    return;
+  }
+
+  g_dbus_object_manager_server_set_connection(self->object_manager,
+                                              self->connection);
+  g_autoptr(GDBusObjectSkeleton) o =
+      g_dbus_object_skeleton_new("/com/canonical/UbuntuAdvantage/Manager");
+  g_dbus_object_skeleton_add_interface(
+      o, G_DBUS_INTERFACE_SKELETON(self->manager));
+  update_status(self, ua_status_monitor_get_status(self->status_monitor));
   g_dbus_object_manager_server_export(self->object_manager, o);
 }
 
+// Called when the com.canonical.UbuntuAdvantage D-Bus name is acquired.
+static void name_acquired_cb(GDBusConnection *connection, const gchar *name,
+                             gpointer user_data) {
+  UaDaemon *self = user_data;
+  trace_startup(self, "name acquired");
+}
+
 // Called when the com.canonical.UbuntuAdvantage D-Bus name is lost to another
 // client or failed to acquire it.
 static void name_lost_cb(GDBusConnection *connection, const gchar *name,
@@ -385,28 +1717,159 @@ static void name_lost_cb(GDBusConnection *connection, const gchar *name,
   g_signal_emit(self, signals[SIGNAL_QUIT], 0);
 }
 
+// Called when connected to the system bus. The objects are exported before
+// the name is requested, so they are present once clients can see the name.
+static void bus_acquired_cb(GDBusConnection *connection, const gchar *name,
+                            gpointer user_data) {
+  UaDaemon *self = user_data;
+
+  self->connection = g_object_ref(connection);
+  self->filter_id = g_dbus_connection_add_filter(
+      self->connection, message_filter_cb, self, NULL);
+  trace_startup(self, "system bus connected");
+
+  export_objects(self);
+  trace_startup(self, "objects exported");
+}
+
+// Called when the polkit authority is ready. Authorization checks use it once
+// it is, rather than each getting the authority first.
+static void authority_get_cb(GObject *object, GAsyncResult *result,
+                             gpointer user_data) {
+  UaDaemon *self = user_data;
+
+  g_autoptr(GError) error = NULL;
+  PolkitAuthority *authority = polkit_authority_get_finish(result, &error);
+  if (authority == NULL) {
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+      return;
+    }
+    // Not fatal, each authorization check tries again.
+    g_warning("Failed to get polkit authority: %s", error->message);
+    return;
+  }
+
+  self->authority = authority;
+  trace_startup(self, "polkit authority ready");
+}
+
+// Connect to the system bus and request the com.canonical.UbuntuAdvantage
+// name. The objects are exported from the current status once connected.
+static void own_name(UaDaemon *self) {
+  GBusNameOwnerFlags bus_flags = G_BUS_NAME_OWNER_FLAGS_ALLOW_REPLACEMENT;
+  if (self->replace) {
+    bus_flags |= G_BUS_NAME_OWNER_FLAGS_REPLACE;
+  }
+  self->owner_id = g_bus_own_name(
+      G_BUS_TYPE_SYSTEM, "com.canonical.UbuntuAdvantage", bus_flags,
+      bus_acquired_cb, name_acquired_cb, name_lost_cb, self, NULL);
+}
+
+// Called when the status file has been read for the first time. If the
+// objects were exported from the cached status they are updated from the file
+// through the status monitor signals. Otherwise they are exported now, so
+// clients never see an empty status before the real one.
+static void status_loaded_cb(GObject *object, GAsyncResult *result,
+                             gpointer user_data) {
+  UaDaemon *self = user_data;
+
+  g_autoptr(GError) error = NULL;
+  if (!ua_status_monitor_wait_loaded_finish(UA_STATUS_MONITOR(object), result,
+                                            &error)) {
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+      return;
+    }
+    g_warning("Failed to load status: %s", error->message);
+  } else {
+    trace_startup(self, "status loaded");
+  }
+
+  if (self->owner_id == 0) {
+    own_name(self);
+  }
+}
+
 static void ua_daemon_dispose(GObject *object) {
   UaDaemon *self = UA_DAEMON(object);
 
+  g_cancellable_cancel(self->cancellable);
+
+  if (self->idle_timeout_id != 0) {
+    g_source_remove(self->idle_timeout_id);
+    self->idle_timeout_id = 0;
+  }
+  if (self->owner_id != 0) {
+    g_bus_unown_name(self->owner_id);
+    self->owner_id = 0;
+  }
+
+  if (self->filter_id != 0) {
+    g_dbus_connection_remove_filter(self->connection, self->filter_id);
+    self->filter_id = 0;
+  }
+
+  g_clear_object(&self->cancellable);
+  g_clear_pointer(&self->context, g_main_context_unref);
   g_clear_object(&self->connection);
+  g_clear_object(&self->authority);
   g_clear_object(&self->object_manager);
   g_clear_object(&self->manager);
   g_clear_object(&self->status_monitor);
-  g_clear_pointer(&self->services, g_ptr_array_unref);
+  g_clear_object(&self->service_tree);
+  g_clear_pointer(&self->services, g_hash_table_unref);
+  g_clear_pointer(&self->service_pool, g_hash_table_unref);
+  g_clear_pointer(&self->operations, g_queue_free);
+  g_clear_pointer(&self->clients, g_hash_table_unref);
+  g_clear_object(&self->scheduler);
+  if (self->pool_order != NULL) {
+    g_queue_free_full(self->pool_order, g_free);
+    self->pool_order = NULL;
+  }
+  g_clear_pointer(&self->pending_changes, g_array_unref);
 
   G_OBJECT_CLASS(ua_daemon_parent_class)->dispose(object);
 }
 
 static void ua_daemon_init(UaDaemon *self) {
+  self->cancellable = g_cancellable_new();
+  self->context = g_main_context_ref_thread_default();
   self->object_manager = g_dbus_object_manager_server_new("/");
   self->manager = ua_ubuntu_advantage_manager_skeleton_new();
-  self->services = g_ptr_array_new_with_free_func(g_object_unref);
+  self->services =
+      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_object_unref);
+  self->service_pool =
+      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_object_unref);
+  self->pool_order = g_queue_new();
+  self->operations = g_queue_new();
+  self->clients = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                                        (GDestroyNotify)client_free);
+  // pro takes a global lock, so run one command at a time.
+  self->scheduler = ua_scheduler_new(1);
+  g_object_bind_property(self->scheduler, "queue-depth", self->manager,
+                         "queue-depth", G_BINDING_SYNC_CREATE);
+  g_object_bind_property(self->scheduler, "last-queue-wait", self->manager,
+                         "last-queue-wait", G_BINDING_SYNC_CREATE);
+  g_signal_connect_swapped(self->scheduler, "progress",
+                           G_CALLBACK(progress_cb), self);
+  self->pending_changes = g_array_new(FALSE, FALSE, sizeof(PendingChange));
+  g_array_set_clear_func(self->pending_changes,
+                         (GDestroyNotify)pending_change_clear);
   ua_ubuntu_advantage_manager_set_daemon_version(self->manager,
                                                  PROJECT_VERSION);
   g_signal_connect_swapped(self->manager, "handle-attach",
                            G_CALLBACK(dbus_attach_cb), self);
   g_signal_connect_swapped(self->manager, "handle-detach",
                            G_CALLBACK(dbus_detach_cb), self);
+  g_signal_connect_swapped(self->manager, "handle-get-services",
+                           G_CALLBACK(dbus_get_services_cb), self);
+  g_signal_connect_swapped(self->manager, "handle-enable-services",
+                           G_CALLBACK(dbus_enable_services_cb), self);
+  g_signal_connect_swapped(self->manager, "handle-disable-services",
+                           G_CALLBACK(dbus_disable_services_cb), self);
+  g_signal_connect_swapped(self->manager, "handle-set-desired-services",
+                           G_CALLBACK(dbus_set_desired_services_cb), self);
+  g_signal_connect_swapped(self->manager, "handle-cancel",
+                           G_CALLBACK(dbus_cancel_cb), self);
 }
 
 static void ua_daemon_class_init(UaDaemonClass *klass) {
@@ -417,26 +1880,41 @@ static void ua_daemon_class_init(UaDaemonClass *klass) {
                    G_SIGNAL_RUN_LAST, 0, NULL, NULL, NULL, G_TYPE_NONE, 0);
 }
 
-UaDaemon *ua_daemon_new(gboolean replace, const char *status_path) {
+UaDaemon *ua_daemon_new(gboolean replace, const char *status_path,
+                        const char *cache_path, gboolean virtual_services,
+                        guint idle_timeout, gboolean startup_trace) {
   UaDaemon *self = g_object_new(ua_daemon_get_type(), NULL);
 
   self->replace = replace;
-  self->status_monitor = ua_status_monitor_new(status_path);
+  self->virtual_services = virtual_services;
+  self->idle_timeout = idle_timeout;
+  self->startup_trace = startup_trace;
+  self->status_monitor = ua_status_monitor_new(status_path, cache_path);
+  g_object_bind_property(self->status_monitor, "provisional", self->manager,
+                         "status-provisional", G_BINDING_SYNC_CREATE);
 
   return self;
 }
 
+// If there is a cached status the objects are exported from it as soon as the
+// system bus is connected, and requesting the name, getting the polkit
+// authority and reading the status file are done concurrently. Without one
+// the name is only requested once the status file has been read.
 gboolean ua_daemon_start(UaDaemon *self, GError **error) {
+  self->start_time = g_get_monotonic_time();
+
   if (!ua_status_monitor_start(self->status_monitor, error)) {
     return FALSE;
   }
+  trace_startup(self, "status monitor started");
 
-  GBusNameOwnerFlags bus_flags = G_BUS_NAME_OWNER_FLAGS_ALLOW_REPLACEMENT;
-  if (self->replace) {
-    bus_flags |= G_BUS_NAME_OWNER_FLAGS_REPLACE;
+  if (ua_status_monitor_has_status(self->status_monitor)) {
+    own_name(self);
   }
-  g_bus_own_name(G_BUS_TYPE_SYSTEM, "com.canonical.UbuntuAdvantage", bus_flags,
-                 bus_acquired_cb, NULL, name_lost_cb, self, NULL);
+  polkit_authority_get_async(self->cancellable, authority_get_cb, self);
+  ua_status_monitor_wait_loaded(self->status_monitor, self->cancellable,
+                                status_loaded_cb, self);
+  reset_idle_timeout(self);
 
   return TRUE;
 }
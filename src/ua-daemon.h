@@ -4,6 +4,8 @@
 
 G_DECLARE_FINAL_TYPE(UaDaemon, ua_daemon, UA, DAEMON, GObject)
 
-UaDaemon *ua_daemon_new(gboolean replace, const gchar *status_path);
+UaDaemon *ua_daemon_new(gboolean replace, const gchar *status_path,
+                        const gchar *cache_path, gboolean virtual_services,
+                        guint idle_timeout, gboolean startup_trace);
 
 gboolean ua_daemon_start(UaDaemon *daemon, GError **error);
@@ -0,0 +1,382 @@
+#include "ua-scheduler.h"
+#include "ua-tool.h"
+
+// Queues pro commands so only a limited number run at once. pro takes a
+// global lock, so commands run concurrently would otherwise fail.
+struct _UaScheduler {
+  GObject parent_instance;
+
+  // Maximum number of commands to run at once.
+  guint max_running;
+  guint n_running;
+
+  // Jobs waiting to run, oldest first.
+  GQueue *queue;
+
+  // Time in microseconds the last job to start spent queued.
+  guint64 last_queue_wait;
+};
+
+G_DEFINE_TYPE(UaScheduler, ua_scheduler, G_TYPE_OBJECT)
+
+enum { PROP_0, PROP_QUEUE_DEPTH, PROP_LAST_QUEUE_WAIT, PROP_LAST };
+
+static GParamSpec *properties[PROP_LAST] = {NULL};
+
+enum { SIGNAL_PROGRESS, SIGNAL_LAST };
+
+static guint signals[SIGNAL_LAST] = {0};
+
+typedef struct {
+  UaScheduler *self;
+  UaOperationType type;
+  gchar *argument;
+  // Services the job enables or disables, empty for attach and detach.
+  gchar **service_names;
+  GTask *task;
+  gint64 queued_time;
+  // Completes the job if it is cancelled while queued.
+  GSource *cancelled_source;
+} Job;
+
+static void job_clear_cancelled_source(Job *job) {
+  if (job->cancelled_source != NULL) {
+    g_source_destroy(job->cancelled_source);
+    g_clear_pointer(&job->cancelled_source, g_source_unref);
+  }
+}
+
+static void job_free(Job *job) {
+  job_clear_cancelled_source(job);
+  g_clear_pointer(&job->argument, g_free);
+  g_clear_pointer(&job->service_names, g_strfreev);
+  g_clear_object(&job->task);
+  g_free(job);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(Job, job_free)
+
+static void run_next(UaScheduler *self);
+
+// Called with each line of output from the pro command for [job].
+static void job_progress_cb(const gchar *line, gpointer user_data) {
+  Job *job = user_data;
+  g_signal_emit(job->self, signals[SIGNAL_PROGRESS], 0, job->type,
+                job->service_names, line, g_task_get_cancellable(job->task));
+}
+
+// Called when the pro command for [job] completes.
+static void job_cb(GObject *object, GAsyncResult *result, gpointer user_data) {
+  g_autoptr(Job) job = user_data;
+  UaScheduler *self = job->self;
+
+  g_autoptr(GError) error = NULL;
+  gboolean success = FALSE;
+  g_autoptr(GPtrArray) results = NULL;
+  switch (job->type) {
+  case UA_OPERATION_ATTACH:
+    success = ua_attach_finish(result, &error);
+    break;
+  case UA_OPERATION_DETACH:
+    success = ua_detach_finish(result, &error);
+    break;
+  case UA_OPERATION_ENABLE:
+    success = ua_enable_finish(result, &error);
+    break;
+  case UA_OPERATION_DISABLE:
+    success = ua_disable_finish(result, &error);
+    break;
+  case UA_OPERATION_ENABLE_SERVICES:
+    results = ua_enable_services_finish(result, &error);
+    success = results != NULL;
+    break;
+  case UA_OPERATION_DISABLE_SERVICES:
+    results = ua_disable_services_finish(result, &error);
+    success = results != NULL;
+    break;
+  }
+
+  self->n_running--;
+  if (results != NULL) {
+    g_task_return_pointer(job->task, g_steal_pointer(&results),
+                          (GDestroyNotify)g_ptr_array_unref);
+  } else if (success) {
+    g_task_return_boolean(job->task, TRUE);
+  } else {
+    g_task_return_error(job->task, g_steal_pointer(&error));
+  }
+
+  run_next(self);
+}
+
+// Start queued jobs until the maximum number are running.
+static void run_next(UaScheduler *self) {
+  while (self->n_running < self->max_running &&
+         !g_queue_is_empty(self->queue)) {
+    Job *job = g_queue_pop_head(self->queue);
+    g_object_notify_by_pspec(G_OBJECT(self), properties[PROP_QUEUE_DEPTH]);
+    job_clear_cancelled_source(job);
+
+    if (g_task_return_error_if_cancelled(job->task)) {
+      job_free(job);
+      continue;
+    }
+
+    self->last_queue_wait = g_get_monotonic_time() - job->queued_time;
+    g_object_notify_by_pspec(G_OBJECT(self),
+                             properties[PROP_LAST_QUEUE_WAIT]);
+
+    self->n_running++;
+    GCancellable *cancellable = g_task_get_cancellable(job->task);
+    switch (job->type) {
+    case UA_OPERATION_ATTACH:
+      ua_attach(job->argument, cancellable, job_progress_cb, job, job_cb,
+                job);
+      break;
+    case UA_OPERATION_DETACH:
+      ua_detach(cancellable, job_progress_cb, job, job_cb, job);
+      break;
+    case UA_OPERATION_ENABLE:
+      ua_enable(job->argument, cancellable, job_progress_cb, job, job_cb,
+                job);
+      break;
+    case UA_OPERATION_DISABLE:
+      ua_disable(job->argument, cancellable, job_progress_cb, job, job_cb,
+                 job);
+      break;
+    case UA_OPERATION_ENABLE_SERVICES:
+      ua_enable_services((const gchar *const *)job->service_names, cancellable,
+                         job_progress_cb, job, job_cb, job);
+      break;
+    case UA_OPERATION_DISABLE_SERVICES:
+      ua_disable_services((const gchar *const *)job->service_names,
+                          cancellable, job_progress_cb, job, job_cb, job);
+      break;
+    }
+  }
+}
+
+// Returns TRUE if running the queued [job] is pointless once an operation of
+// [type] with [argument] has run, i.e. enabling a service that is then
+// disabled, or the reverse.
+static gboolean is_superseded_by(Job *job, UaOperationType type,
+                                 const gchar *argument) {
+  if (g_strcmp0(job->argument, argument) != 0) {
+    return FALSE;
+  }
+
+  return (job->type == UA_OPERATION_ENABLE && type == UA_OPERATION_DISABLE) ||
+         (job->type == UA_OPERATION_DISABLE && type == UA_OPERATION_ENABLE);
+}
+
+// Complete a queued [job] that a later request made moot. This runs from an
+// idle source, so the request completes on a later main loop iteration rather
+// than inside the ua_scheduler_run() call that superseded it.
+static gboolean return_superseded_cb(gpointer user_data) {
+  Job *job = user_data;
+  g_task_return_new_error(job->task, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                          "Superseded by a later request");
+  job_free(job);
+
+  return G_SOURCE_REMOVE;
+}
+
+// Drop queued jobs that an operation of [type] with [argument] makes moot.
+static void remove_superseded(UaScheduler *self, UaOperationType type,
+                              const gchar *argument) {
+  gboolean removed = FALSE;
+  GList *link = self->queue->head;
+  while (link != NULL) {
+    GList *next = link->next;
+    Job *job = link->data;
+    if (is_superseded_by(job, type, argument)) {
+      g_queue_delete_link(self->queue, link);
+      job_clear_cancelled_source(job);
+      GSource *source = g_idle_source_new();
+      g_source_set_callback(source, return_superseded_cb, job, NULL);
+      g_source_attach(source, g_task_get_context(job->task));
+      g_source_unref(source);
+      removed = TRUE;
+    }
+    link = next;
+  }
+
+  if (removed) {
+    g_object_notify_by_pspec(G_OBJECT(self), properties[PROP_QUEUE_DEPTH]);
+  }
+}
+
+static void ua_scheduler_get_property(GObject *object, guint prop_id,
+                                      GValue *value, GParamSpec *pspec) {
+  UaScheduler *self = UA_SCHEDULER(object);
+
+  switch (prop_id) {
+  case PROP_QUEUE_DEPTH:
+    g_value_set_uint(value, ua_scheduler_get_queue_depth(self));
+    break;
+  case PROP_LAST_QUEUE_WAIT:
+    g_value_set_uint64(value, self->last_queue_wait);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+}
+
+static void ua_scheduler_dispose(GObject *object) {
+  UaScheduler *self = UA_SCHEDULER(object);
+
+  // Jobs hold a reference to the scheduler through their task, so the queue
+  // is empty here.
+  g_clear_pointer(&self->queue, g_queue_free);
+
+  G_OBJECT_CLASS(ua_scheduler_parent_class)->dispose(object);
+}
+
+static void ua_scheduler_init(UaScheduler *self) {
+  self->queue = g_queue_new();
+}
+
+static void ua_scheduler_class_init(UaSchedulerClass *klass) {
+  GObjectClass *object_class = G_OBJECT_CLASS(klass);
+
+  object_class->dispose = ua_scheduler_dispose;
+  object_class->get_property = ua_scheduler_get_property;
+
+  properties[PROP_QUEUE_DEPTH] =
+      g_param_spec_uint("queue-depth", NULL, NULL, 0, G_MAXUINT, 0,
+                        G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  properties[PROP_LAST_QUEUE_WAIT] =
+      g_param_spec_uint64("last-queue-wait", NULL, NULL, 0, G_MAXUINT64, 0,
+                          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_properties(object_class, PROP_LAST, properties);
+
+  // Emitted with the operation type, the services affected and each line of
+  // output from a running pro command, followed by the cancellable the
+  // command was queued with so the output can be matched to its requester.
+  signals[SIGNAL_PROGRESS] = g_signal_new(
+      "progress", G_TYPE_FROM_CLASS(G_OBJECT_CLASS(klass)), G_SIGNAL_RUN_LAST,
+      0, NULL, NULL, NULL, G_TYPE_NONE, 4, G_TYPE_INT, G_TYPE_STRV,
+      G_TYPE_STRING, G_TYPE_CANCELLABLE);
+}
+
+// Create a scheduler that runs up to [max_running] pro commands at once.
+UaScheduler *ua_scheduler_new(guint max_running) {
+  g_return_val_if_fail(max_running > 0, NULL);
+
+  UaScheduler *self = g_object_new(ua_scheduler_get_type(), NULL);
+  self->max_running = max_running;
+
+  return self;
+}
+
+static Job *job_new(UaScheduler *self, UaOperationType type,
+                    GCancellable *cancellable, GAsyncReadyCallback callback,
+                    gpointer callback_data) {
+  Job *job = g_new0(Job, 1);
+  job->self = self;
+  job->type = type;
+  job->task = g_task_new(self, cancellable, callback, callback_data);
+  job->queued_time = g_get_monotonic_time();
+
+  return job;
+}
+
+// Called when a queued [job] is cancelled, so it completes without waiting
+// for the jobs ahead of it.
+static gboolean job_cancelled_cb(GCancellable *cancellable,
+                                 gpointer user_data) {
+  Job *job = user_data;
+  UaScheduler *self = job->self;
+
+  g_queue_remove(self->queue, job);
+  g_object_notify_by_pspec(G_OBJECT(self), properties[PROP_QUEUE_DEPTH]);
+  g_task_return_error_if_cancelled(job->task);
+  job_free(job);
+
+  return G_SOURCE_REMOVE;
+}
+
+// Add [job] to the queue and start it if possible.
+static void queue_job(UaScheduler *self, Job *job) {
+  GCancellable *cancellable = g_task_get_cancellable(job->task);
+  if (cancellable != NULL) {
+    job->cancelled_source = g_cancellable_source_new(cancellable);
+    g_source_set_callback(job->cancelled_source,
+                          (GSourceFunc)job_cancelled_cb, job, NULL);
+    g_source_attach(job->cancelled_source, g_task_get_context(job->task));
+  }
+  g_queue_push_tail(self->queue, job);
+  g_object_notify_by_pspec(G_OBJECT(self), properties[PROP_QUEUE_DEPTH]);
+
+  run_next(self);
+}
+
+// Queue the pro command for [type] with [argument] (a token or service name).
+// Queued commands that this one makes moot complete with
+// G_IO_ERROR_CANCELLED. If [cancellable] is triggered the command is dropped
+// from the queue, or terminated if already running.
+void ua_scheduler_run(UaScheduler *self, UaOperationType type,
+                      const gchar *argument, GCancellable *cancellable,
+                      GAsyncReadyCallback callback, gpointer callback_data) {
+  g_return_if_fail(UA_IS_SCHEDULER(self));
+  g_return_if_fail(type != UA_OPERATION_ENABLE_SERVICES &&
+                   type != UA_OPERATION_DISABLE_SERVICES);
+
+  remove_superseded(self, type, argument);
+
+  Job *job = job_new(self, type, cancellable, callback, callback_data);
+  job->argument = g_strdup(argument);
+  if (type == UA_OPERATION_ENABLE || type == UA_OPERATION_DISABLE) {
+    const gchar *service_names[] = {argument, NULL};
+    job->service_names = g_strdupv((gchar **)service_names);
+  } else {
+    job->service_names = g_new0(gchar *, 1);
+  }
+  queue_job(self, job);
+}
+
+// Complete request started with ua_scheduler_run().
+gboolean ua_scheduler_run_finish(UaScheduler *self, GAsyncResult *result,
+                                 GError **error) {
+  g_return_val_if_fail(g_task_is_valid(result, self), FALSE);
+  return g_task_propagate_boolean(G_TASK(result), error);
+}
+
+// Queue a single pro command of [type] (UA_OPERATION_ENABLE_SERVICES or
+// UA_OPERATION_DISABLE_SERVICES) for all of [service_names].
+void ua_scheduler_run_services(UaScheduler *self, UaOperationType type,
+                               const gchar *const *service_names,
+                               GCancellable *cancellable,
+                               GAsyncReadyCallback callback,
+                               gpointer callback_data) {
+  g_return_if_fail(UA_IS_SCHEDULER(self));
+  g_return_if_fail(type == UA_OPERATION_ENABLE_SERVICES ||
+                   type == UA_OPERATION_DISABLE_SERVICES);
+
+  Job *job = job_new(self, type, cancellable, callback, callback_data);
+  job->service_names = g_strdupv((gchar **)service_names);
+  queue_job(self, job);
+}
+
+// Complete request started with ua_scheduler_run_services(). Returns an array
+// of UaServiceResult, one for each service in the order requested.
+GPtrArray *ua_scheduler_run_services_finish(UaScheduler *self,
+                                            GAsyncResult *result,
+                                            GError **error) {
+  g_return_val_if_fail(g_task_is_valid(result, self), NULL);
+  return g_task_propagate_pointer(G_TASK(result), error);
+}
+
+// Get the number of commands waiting to run.
+guint ua_scheduler_get_queue_depth(UaScheduler *self) {
+  g_return_val_if_fail(UA_IS_SCHEDULER(self), 0);
+  return g_queue_get_length(self->queue);
+}
+
+// Get the time in microseconds the most recently started command waited in
+// the queue.
+guint64 ua_scheduler_get_last_queue_wait(UaScheduler *self) {
+  g_return_val_if_fail(UA_IS_SCHEDULER(self), 0);
+  return self->last_queue_wait;
+}
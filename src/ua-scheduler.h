@@ -0,0 +1,37 @@
+#pragma once
+
+#include <gio/gio.h>
+
+G_DECLARE_FINAL_TYPE(UaScheduler, ua_scheduler, UA, SCHEDULER, GObject)
+
+typedef enum {
+  UA_OPERATION_ATTACH,
+  UA_OPERATION_DETACH,
+  UA_OPERATION_ENABLE,
+  UA_OPERATION_DISABLE,
+  UA_OPERATION_ENABLE_SERVICES,
+  UA_OPERATION_DISABLE_SERVICES,
+} UaOperationType;
+
+UaScheduler *ua_scheduler_new(guint max_running);
+
+void ua_scheduler_run(UaScheduler *scheduler, UaOperationType type,
+                      const gchar *argument, GCancellable *cancellable,
+                      GAsyncReadyCallback callback, gpointer callback_data);
+
+gboolean ua_scheduler_run_finish(UaScheduler *scheduler, GAsyncResult *result,
+                                 GError **error);
+
+void ua_scheduler_run_services(UaScheduler *scheduler, UaOperationType type,
+                               const gchar *const *service_names,
+                               GCancellable *cancellable,
+                               GAsyncReadyCallback callback,
+                               gpointer callback_data);
+
+GPtrArray *ua_scheduler_run_services_finish(UaScheduler *scheduler,
+                                            GAsyncResult *result,
+                                            GError **error);
+
+guint ua_scheduler_get_queue_depth(UaScheduler *scheduler);
+
+guint64 ua_scheduler_get_last_queue_wait(UaScheduler *scheduler);
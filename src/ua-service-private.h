@@ -0,0 +1,21 @@
+#pragma once
+
+#include "ua-service.h"
+
+// Services are stored inline in the UaStatus snapshot, with the name and
+// description pointing into the string block of the snapshot.
+struct _UaService {
+  const gchar *name;
+  const gchar *description;
+
+  // Known values point to static strings, shared between all services.
+  // Unknown values point into the string block of the snapshot.
+  const gchar *entitled;
+  const gchar *status;
+
+  UaServiceEntitlement entitlement;
+  UaServiceState state;
+};
+
+void ua_service_set_values(UaService *service, const gchar *entitled,
+                           const gchar *status);
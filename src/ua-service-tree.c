@@ -0,0 +1,460 @@
+#include <string.h>
+
+#include "ua-service-tree.h"
+
+#define MANAGER_PATH "/com/canonical/UbuntuAdvantage/Manager"
+#define SERVICES_PATH "/com/canonical/UbuntuAdvantage/Services"
+#define MANAGER_INTERFACE "com.canonical.UbuntuAdvantage.Manager"
+#define SERVICE_INTERFACE "com.canonical.UbuntuAdvantage.Service"
+#define OBJECT_MANAGER_INTERFACE "org.freedesktop.DBus.ObjectManager"
+
+// Serves the service objects directly from the current status snapshot, using
+// a D-Bus subtree instead of a skeleton per service. As the services are not
+// known to a GDBusObjectManagerServer, this also implements the
+// org.freedesktop.DBus.ObjectManager interface on the root object.
+struct _UaServiceTree {
+  GObject parent_instance;
+
+  UaStatusMonitor *status_monitor;
+  UaUbuntuAdvantageManager *manager;
+  GDBusConnection *connection;
+  GDBusNodeInfo *object_manager_info;
+  guint object_manager_id;
+  guint subtree_id;
+};
+
+G_DEFINE_TYPE(UaServiceTree, ua_service_tree, G_TYPE_OBJECT)
+
+enum { SIGNAL_HANDLE_ENABLE, SIGNAL_HANDLE_DISABLE, SIGNAL_LAST };
+
+static guint signals[SIGNAL_LAST] = {0};
+
+static const gchar object_manager_xml[] =
+    "<node>"
+    "  <interface name='org.freedesktop.DBus.ObjectManager'>"
+    "    <method name='GetManagedObjects'>"
+    "      <arg type='a{oa{sa{sv}}}' name='objects' direction='out'/>"
+    "    </method>"
+    "    <signal name='InterfacesAdded'>"
+    "      <arg type='o' name='object_path'/>"
+    "      <arg type='a{sa{sv}}' name='interfaces_and_properties'/>"
+    "    </signal>"
+    "    <signal name='InterfacesRemoved'>"
+    "      <arg type='o' name='object_path'/>"
+    "      <arg type='as' name='interfaces'/>"
+    "    </signal>"
+    "  </interface>"
+    "</node>";
+
+// Escape [s] so that it can be used in a D-Bus object path.
+// This implements g_dbus_escape_object_path, which requires glib 2.68
+static gchar *escape_object_path(const gchar *s) {
+  GString *escaped = g_string_new("");
+  for (const gchar *c = s; *c != '\0'; c++) {
+    if (g_ascii_isalnum(*c)) {
+      g_string_append_c(escaped, *c);
+    } else {
+      g_string_append_printf(escaped, "_%02x", *c);
+    }
+  }
+  return g_string_free(escaped, FALSE);
+}
+
+// Reverse escape_object_path(), returning NULL if [s] is not a string it
+// would produce. Only that form is accepted, so each service is reachable
+// through a single object path.
+static gchar *unescape_object_path(const gchar *s) {
+  GString *unescaped = g_string_new("");
+  for (const gchar *c = s; *c != '\0'; c++) {
+    if (*c != '_') {
+      g_string_append_c(unescaped, *c);
+      continue;
+    }
+
+    int high = g_ascii_xdigit_value(c[1]);
+    int low = high >= 0 ? g_ascii_xdigit_value(c[2]) : -1;
+    if (low < 0) {
+      g_string_free(unescaped, TRUE);
+      return NULL;
+    }
+    g_string_append_c(unescaped, high << 4 | low);
+    c += 2;
+  }
+
+  // Reject alternative forms, such as escaped alphanumerics, upper case hex
+  // digits and escaped nul bytes.
+  g_autofree gchar *name = g_string_free(unescaped, FALSE);
+  g_autofree gchar *escaped = escape_object_path(name);
+  if (g_strcmp0(escaped, s) != 0) {
+    return NULL;
+  }
+
+  return g_steal_pointer(&name);
+}
+
+// Get the D-Bus object path for a UA service with name [service_name].
+gchar *ua_service_tree_get_object_path(const gchar *service_name) {
+  g_autofree gchar *escaped_name = escape_object_path(service_name);
+  return g_strdup_printf(SERVICES_PATH "/%s", escaped_name);
+}
+
+static void add_properties(GVariantBuilder *builder, UaService *service,
+                           guint fields) {
+  if (fields & UA_SERVICE_FIELD_DESCRIPTION) {
+    const gchar *description = ua_service_get_description(service);
+    g_variant_builder_add(builder, "{sv}", "Description",
+                          g_variant_new_string(description));
+  }
+  if (fields & UA_SERVICE_FIELD_ENTITLED) {
+    const gchar *entitled = ua_service_get_entitled(service);
+    g_variant_builder_add(builder, "{sv}", "Entitled",
+                          g_variant_new_string(entitled));
+  }
+  if (fields & UA_SERVICE_FIELD_STATUS) {
+    const gchar *status = ua_service_get_status(service);
+    g_variant_builder_add(builder, "{sv}", "Status",
+                          g_variant_new_string(status));
+  }
+}
+
+// Get the D-Bus property values for the [fields] of [service].
+GVariant *ua_service_tree_get_properties(UaService *service, guint fields) {
+  GVariantBuilder properties;
+  g_variant_builder_init(&properties, G_VARIANT_TYPE("a{sv}"));
+  add_properties(&properties, service, fields);
+  return g_variant_builder_end(&properties);
+}
+
+// Get all the D-Bus property values for [service].
+static GVariant *get_all_properties(UaService *service) {
+  GVariantBuilder properties;
+  g_variant_builder_init(&properties, G_VARIANT_TYPE("a{sv}"));
+  g_variant_builder_add(&properties, "{sv}", "Name",
+                        g_variant_new_string(ua_service_get_name(service)));
+  add_properties(&properties, service, UA_SERVICE_FIELD_ALL);
+  return g_variant_builder_end(&properties);
+}
+
+// Get the service in the current status for the object path [node].
+static UaService *lookup_node(UaServiceTree *self, const gchar *node) {
+  g_autofree gchar *name = unescape_object_path(node);
+  if (name == NULL) {
+    return NULL;
+  }
+
+  UaStatus *status = ua_status_monitor_get_status(self->status_monitor);
+  return ua_status_get_service(status, name);
+}
+
+// Get the service in the current status for [object_path].
+static UaService *lookup_object_path(UaServiceTree *self,
+                                     const gchar *object_path) {
+  if (!g_str_has_prefix(object_path, SERVICES_PATH "/")) {
+    return NULL;
+  }
+  return lookup_node(self, object_path + strlen(SERVICES_PATH "/"));
+}
+
+static void service_method_call_cb(
+    GDBusConnection *connection, const gchar *sender, const gchar *object_path,
+    const gchar *interface_name, const gchar *method_name, GVariant *parameters,
+    GDBusMethodInvocation *invocation, gpointer user_data) {
+  UaServiceTree *self = user_data;
+
+  UaService *service = lookup_object_path(self, object_path);
+  if (service == NULL) {
+    g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR,
+                                          G_DBUS_ERROR_UNKNOWN_OBJECT,
+                                          "No such service %s", object_path);
+    return;
+  }
+
+  gboolean handled = FALSE;
+  if (g_strcmp0(method_name, "Enable") == 0) {
+    g_signal_emit(self, signals[SIGNAL_HANDLE_ENABLE], 0, invocation,
+                  ua_service_get_name(service), &handled);
+  } else if (g_strcmp0(method_name, "Disable") == 0) {
+    g_signal_emit(self, signals[SIGNAL_HANDLE_DISABLE], 0, invocation,
+                  ua_service_get_name(service), &handled);
+  }
+  if (!handled) {
+    g_dbus_method_invocation_return_error(
+        invocation, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD,
+        "Unknown method %s", method_name);
+  }
+}
+
+static GVariant *service_get_property_cb(GDBusConnection *connection,
+                                         const gchar *sender,
+                                         const gchar *object_path,
+                                         const gchar *interface_name,
+                                         const gchar *property_name,
+                                         GError **error, gpointer user_data) {
+  UaServiceTree *self = user_data;
+
+  UaService *service = lookup_object_path(self, object_path);
+  if (service == NULL) {
+    g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_OBJECT,
+                "No such service %s", object_path);
+    return NULL;
+  }
+
+  if (g_strcmp0(property_name, "Name") == 0) {
+    return g_variant_new_string(ua_service_get_name(service));
+  } else if (g_strcmp0(property_name, "Description") == 0) {
+    return g_variant_new_string(ua_service_get_description(service));
+  } else if (g_strcmp0(property_name, "Entitled") == 0) {
+    return g_variant_new_string(ua_service_get_entitled(service));
+  } else if (g_strcmp0(property_name, "Status") == 0) {
+    return g_variant_new_string(ua_service_get_status(service));
+  }
+
+  g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_PROPERTY,
+              "Unknown property %s", property_name);
+  return NULL;
+}
+
+static const GDBusInterfaceVTable service_vtable = {
+    .method_call = service_method_call_cb,
+    .get_property = service_get_property_cb,
+};
+
+// Returns the escaped names of the current services.
+static gchar **subtree_enumerate_cb(GDBusConnection *connection,
+                                    const gchar *sender,
+                                    const gchar *object_path,
+                                    gpointer user_data) {
+  UaServiceTree *self = user_data;
+
+  UaStatus *status = ua_status_monitor_get_status(self->status_monitor);
+  guint n_services = ua_status_get_n_services(status);
+  gchar **nodes = g_new0(gchar *, n_services + 1);
+  for (guint i = 0; i < n_services; i++) {
+    UaService *service = ua_status_get_service_by_index(status, i);
+    nodes[i] = escape_object_path(ua_service_get_name(service));
+  }
+
+  return nodes;
+}
+
+static GDBusInterfaceInfo **
+subtree_introspect_cb(GDBusConnection *connection, const gchar *sender,
+                      const gchar *object_path, const gchar *node,
+                      gpointer user_data) {
+  UaServiceTree *self = user_data;
+
+  if (node == NULL || lookup_node(self, node) == NULL) {
+    return NULL;
+  }
+
+  GDBusInterfaceInfo **interfaces = g_new0(GDBusInterfaceInfo *, 2);
+  interfaces[0] =
+      g_dbus_interface_info_ref(ua_ubuntu_advantage_service_interface_info());
+  return interfaces;
+}
+
+static const GDBusInterfaceVTable *
+subtree_dispatch_cb(GDBusConnection *connection, const gchar *sender,
+                    const gchar *object_path, const gchar *interface_name,
+                    const gchar *node, gpointer *out_user_data,
+                    gpointer user_data) {
+  UaServiceTree *self = user_data;
+
+  if (node == NULL || g_strcmp0(interface_name, SERVICE_INTERFACE) != 0 ||
+      lookup_node(self, node) == NULL) {
+    return NULL;
+  }
+
+  *out_user_data = user_data;
+  return &service_vtable;
+}
+
+static const GDBusSubtreeVTable subtree_vtable = {
+    .enumerate = subtree_enumerate_cb,
+    .introspect = subtree_introspect_cb,
+    .dispatch = subtree_dispatch_cb,
+};
+
+// Add an object with a single interface to [objects].
+static void add_object(GVariantBuilder *objects, const gchar *object_path,
+                       const gchar *interface_name, GVariant *properties) {
+  GVariantBuilder interfaces;
+  g_variant_builder_init(&interfaces, G_VARIANT_TYPE("a{sa{sv}}"));
+  g_variant_builder_add(&interfaces, "{s@a{sv}}", interface_name, properties);
+  g_variant_builder_add(objects, "{oa{sa{sv}}}", object_path, &interfaces);
+}
+
+// Called when a client calls
+// org.freedesktop.DBus.ObjectManager.GetManagedObjects().
+static void object_manager_method_call_cb(
+    GDBusConnection *connection, const gchar *sender, const gchar *object_path,
+    const gchar *interface_name, const gchar *method_name, GVariant *parameters,
+    GDBusMethodInvocation *invocation, gpointer user_data) {
+  UaServiceTree *self = user_data;
+
+  GVariantBuilder objects;
+  g_variant_builder_init(&objects, G_VARIANT_TYPE("a{oa{sa{sv}}}"));
+
+  g_autoptr(GVariant) manager_properties =
+      g_variant_ref_sink(g_dbus_interface_skeleton_get_properties(
+          G_DBUS_INTERFACE_SKELETON(self->manager)));
+  add_object(&objects, MANAGER_PATH, MANAGER_INTERFACE, manager_properties);
+
+  UaStatus *status = ua_status_monitor_get_status(self->status_monitor);
+  for (guint i = 0; i < ua_status_get_n_services(status); i++) {
+    UaService *service = ua_status_get_service_by_index(status, i);
+    g_autofree gchar *service_path =
+        ua_service_tree_get_object_path(ua_service_get_name(service));
+    add_object(&objects, service_path, SERVICE_INTERFACE,
+               get_all_properties(service));
+  }
+
+  g_dbus_method_invocation_return_value(
+      invocation, g_variant_new("(a{oa{sa{sv}}})", &objects));
+}
+
+static const GDBusInterfaceVTable object_manager_vtable = {
+    .method_call = object_manager_method_call_cb,
+};
+
+static void ua_service_tree_dispose(GObject *object) {
+  UaServiceTree *self = UA_SERVICE_TREE(object);
+
+  if (self->connection != NULL) {
+    if (self->subtree_id != 0) {
+      g_dbus_connection_unregister_subtree(self->connection,
+                                           self->subtree_id);
+      self->subtree_id = 0;
+    }
+    if (self->object_manager_id != 0) {
+      g_dbus_connection_unregister_object(self->connection,
+                                          self->object_manager_id);
+      self->object_manager_id = 0;
+    }
+  }
+
+  g_clear_object(&self->status_monitor);
+  g_clear_object(&self->manager);
+  g_clear_object(&self->connection);
+  g_clear_pointer(&self->object_manager_info, g_dbus_node_info_unref);
+
+  G_OBJECT_CLASS(ua_service_tree_parent_class)->dispose(object);
+}
+
+static void ua_service_tree_init(UaServiceTree *self) {}
+
+static void ua_service_tree_class_init(UaServiceTreeClass *klass) {
+  G_OBJECT_CLASS(klass)->dispose = ua_service_tree_dispose;
+
+  // Emitted with the method invocation and service name when a client calls
+  // com.canonical.UbuntuAdvantage.Service.Enable(). Return TRUE if handled.
+  signals[SIGNAL_HANDLE_ENABLE] = g_signal_new(
+      "handle-enable", G_TYPE_FROM_CLASS(G_OBJECT_CLASS(klass)),
+      G_SIGNAL_RUN_LAST, 0, g_signal_accumulator_true_handled, NULL, NULL,
+      G_TYPE_BOOLEAN, 2, G_TYPE_DBUS_METHOD_INVOCATION, G_TYPE_STRING);
+  // As above, for com.canonical.UbuntuAdvantage.Service.Disable().
+  signals[SIGNAL_HANDLE_DISABLE] = g_signal_new(
+      "handle-disable", G_TYPE_FROM_CLASS(G_OBJECT_CLASS(klass)),
+      G_SIGNAL_RUN_LAST, 0, g_signal_accumulator_true_handled, NULL, NULL,
+      G_TYPE_BOOLEAN, 2, G_TYPE_DBUS_METHOD_INVOCATION, G_TYPE_STRING);
+}
+
+// Create a service tree serving the services in the status from
+// [status_monitor]. [manager] is reported by the object manager.
+UaServiceTree *ua_service_tree_new(UaStatusMonitor *status_monitor,
+                                   UaUbuntuAdvantageManager *manager) {
+  UaServiceTree *self = g_object_new(ua_service_tree_get_type(), NULL);
+
+  self->status_monitor = g_object_ref(status_monitor);
+  self->manager = g_object_ref(manager);
+
+  return self;
+}
+
+// Register the object manager and service objects on [connection].
+gboolean ua_service_tree_export(UaServiceTree *self,
+                                GDBusConnection *connection, GError **error) {
+  g_return_val_if_fail(UA_IS_SERVICE_TREE(self), FALSE);
+  g_return_val_if_fail(self->connection == NULL, FALSE);
+
+  self->connection = g_object_ref(connection);
+
+  self->object_manager_info =
+      g_dbus_node_info_new_for_xml(object_manager_xml, error);
+  if (self->object_manager_info == NULL) {
+    return FALSE;
+  }
+  self->object_manager_id = g_dbus_connection_register_object(
+      connection, "/", self->object_manager_info->interfaces[0],
+      &object_manager_vtable, self, NULL, error);
+  if (self->object_manager_id == 0) {
+    return FALSE;
+  }
+
+  // Nodes are looked up in the snapshot on dispatch, so there's no need for
+  // GDBus to enumerate every service on each call.
+  self->subtree_id = g_dbus_connection_register_subtree(
+      connection, SERVICES_PATH, &subtree_vtable,
+      G_DBUS_SUBTREE_FLAGS_DISPATCH_TO_UNENUMERATED_NODES, self, NULL, error);
+  if (self->subtree_id == 0) {
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+// Notify clients that [service] has been added.
+void ua_service_tree_emit_added(UaServiceTree *self, UaService *service) {
+  g_return_if_fail(UA_IS_SERVICE_TREE(self));
+
+  if (self->connection == NULL) {
+    return;
+  }
+
+  g_autofree gchar *object_path =
+      ua_service_tree_get_object_path(ua_service_get_name(service));
+  GVariantBuilder interfaces;
+  g_variant_builder_init(&interfaces, G_VARIANT_TYPE("a{sa{sv}}"));
+  g_variant_builder_add(&interfaces, "{s@a{sv}}", SERVICE_INTERFACE,
+                        get_all_properties(service));
+  g_dbus_connection_emit_signal(
+      self->connection, NULL, "/", OBJECT_MANAGER_INTERFACE, "InterfacesAdded",
+      g_variant_new("(oa{sa{sv}})", object_path, &interfaces), NULL);
+}
+
+// Notify clients that the service with [name] has been removed.
+void ua_service_tree_emit_removed(UaServiceTree *self, const gchar *name) {
+  g_return_if_fail(UA_IS_SERVICE_TREE(self));
+
+  if (self->connection == NULL) {
+    return;
+  }
+
+  g_autofree gchar *object_path = ua_service_tree_get_object_path(name);
+  const gchar *interfaces[] = {SERVICE_INTERFACE, NULL};
+  g_dbus_connection_emit_signal(
+      self->connection, NULL, "/", OBJECT_MANAGER_INTERFACE,
+      "InterfacesRemoved", g_variant_new("(o^as)", object_path, interfaces),
+      NULL);
+}
+
+// Notify clients that the [fields] of [service] have changed.
+void ua_service_tree_emit_changed(UaServiceTree *self, UaService *service,
+                                  guint fields) {
+  g_return_if_fail(UA_IS_SERVICE_TREE(self));
+
+  if (self->connection == NULL) {
+    return;
+  }
+
+  g_autofree gchar *object_path =
+      ua_service_tree_get_object_path(ua_service_get_name(service));
+  const gchar *invalidated_properties[] = {NULL};
+  g_dbus_connection_emit_signal(
+      self->connection, NULL, object_path, "org.freedesktop.DBus.Properties",
+      "PropertiesChanged",
+      g_variant_new("(s@a{sv}^as)", SERVICE_INTERFACE,
+                    ua_service_tree_get_properties(service, fields),
+                    invalidated_properties),
+      NULL);
+}
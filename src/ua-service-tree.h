@@ -0,0 +1,26 @@
+#pragma once
+
+#include <gio/gio.h>
+
+#include "ua-status-monitor.h"
+#include "ua-ubuntu-advantage-generated.h"
+
+G_DECLARE_FINAL_TYPE(UaServiceTree, ua_service_tree, UA, SERVICE_TREE,
+                     GObject)
+
+UaServiceTree *ua_service_tree_new(UaStatusMonitor *status_monitor,
+                                   UaUbuntuAdvantageManager *manager);
+
+gboolean ua_service_tree_export(UaServiceTree *tree,
+                                GDBusConnection *connection, GError **error);
+
+void ua_service_tree_emit_added(UaServiceTree *tree, UaService *service);
+
+void ua_service_tree_emit_removed(UaServiceTree *tree, const gchar *name);
+
+void ua_service_tree_emit_changed(UaServiceTree *tree, UaService *service,
+                                  guint fields);
+
+gchar *ua_service_tree_get_object_path(const gchar *service_name);
+
+GVariant *ua_service_tree_get_properties(UaService *service, guint fields);
@@ -1,65 +1,108 @@
-#include "ua-service.h"
+#include "ua-service-private.h"
 
-struct _UaService {
-  GObject parent_instance;
-
-  gchar *name;
-  gchar *description;
-  gchar *entitled;
-  gchar *status;
+static const gchar *entitlement_names[] = {
+    [UA_SERVICE_ENTITLEMENT_YES] = "yes",
+    [UA_SERVICE_ENTITLEMENT_NO] = "no",
 };
 
-G_DEFINE_TYPE(UaService, ua_service, G_TYPE_OBJECT)
-
-static void ua_service_dispose(GObject *object) {
-  UaService *self = UA_SERVICE(object);
-
-  g_clear_pointer(&self->name, g_free);
-  g_clear_pointer(&self->description, g_free);
-  g_clear_pointer(&self->entitled, g_free);
-  g_clear_pointer(&self->status, g_free);
-
-  G_OBJECT_CLASS(ua_service_parent_class)->dispose(object);
-}
-
-static void ua_service_init(UaService *self) {}
+static const gchar *state_names[] = {
+    [UA_SERVICE_STATE_ENABLED] = "enabled",
+    [UA_SERVICE_STATE_DISABLED] = "disabled",
+    [UA_SERVICE_STATE_NOT_APPLICABLE] = "n/a",
+    [UA_SERVICE_STATE_WARNING] = "warning",
+};
 
-static void ua_service_class_init(UaServiceClass *klass) {
-  G_OBJECT_CLASS(klass)->dispose = ua_service_dispose;
+// Returns the index of [value] in [names], or 0 if not present.
+static guint lookup_name(const gchar **names, guint n_names,
+                         const gchar *value) {
+  for (guint i = 1; i < n_names; i++) {
+    if (g_strcmp0(names[i], value) == 0) {
+      return i;
+    }
+  }
+  return 0;
 }
 
-UaService *ua_service_new(const gchar *name, const gchar *description,
-                          const gchar *entitled, const gchar *status) {
-  UaService *self = g_object_new(ua_service_get_type(), NULL);
-
-  self->name = g_strdup(name);
-  self->description = g_strdup(description);
-  self->entitled = g_strdup(entitled);
-  self->status = g_strdup(status);
-
-  return self;
+// Set the entitlement and state of [self] from [entitled] and [status]. The
+// strings of known values are set to static copies, unknown values are left
+// as NULL for the caller to store.
+void ua_service_set_values(UaService *self, const gchar *entitled,
+                           const gchar *status) {
+  self->entitlement = lookup_name(
+      entitlement_names, G_N_ELEMENTS(entitlement_names), entitled);
+  self->entitled = entitlement_names[self->entitlement];
+  self->state = lookup_name(state_names, G_N_ELEMENTS(state_names), status);
+  self->status = state_names[self->state];
 }
 
 // Returns the name of the Ubuntu Advantage service.
 const gchar *ua_service_get_name(UaService *self) {
-  g_return_val_if_fail(UA_IS_SERVICE(self), NULL);
+  g_return_val_if_fail(self != NULL, NULL);
   return self->name;
 }
 
 // Returns the description of the Ubuntu Advantage service.
 const gchar *ua_service_get_description(UaService *self) {
-  g_return_val_if_fail(UA_IS_SERVICE(self), NULL);
+  g_return_val_if_fail(self != NULL, NULL);
   return self->description;
 }
 
 // Returns the entitlement to this service.
 const gchar *ua_service_get_entitled(UaService *self) {
-  g_return_val_if_fail(UA_IS_SERVICE(self), NULL);
+  g_return_val_if_fail(self != NULL, NULL);
   return self->entitled;
 }
 
 // Returns the status of this service.
 const gchar *ua_service_get_status(UaService *self) {
-  g_return_val_if_fail(UA_IS_SERVICE(self), NULL);
+  g_return_val_if_fail(self != NULL, NULL);
   return self->status;
 }
+
+// Returns the entitlement to this service, or UA_SERVICE_ENTITLEMENT_UNKNOWN
+// if the value is not recognised. ua_service_get_entitled() returns the
+// original value.
+UaServiceEntitlement ua_service_get_entitlement(UaService *self) {
+  g_return_val_if_fail(self != NULL, UA_SERVICE_ENTITLEMENT_UNKNOWN);
+  return self->entitlement;
+}
+
+// Returns the state of this service, or UA_SERVICE_STATE_UNKNOWN if the value
+// is not recognised. ua_service_get_status() returns the original value.
+UaServiceState ua_service_get_state(UaService *self) {
+  g_return_val_if_fail(self != NULL, UA_SERVICE_STATE_UNKNOWN);
+  return self->state;
+}
+
+// Returns TRUE if [self] and [service] have the same values.
+gboolean ua_service_equal(UaService *self, UaService *service) {
+  g_return_val_if_fail(self != NULL, FALSE);
+  g_return_val_if_fail(service != NULL, FALSE);
+  return g_strcmp0(self->name, service->name) == 0 &&
+         ua_service_diff(self, service) == 0;
+}
+
+// Returns TRUE if the values [a] and [b] differ. Known values are static
+// strings, so are usually matched by pointer.
+static gboolean value_differs(const gchar *a, const gchar *b) {
+  return a != b && g_strcmp0(a, b) != 0;
+}
+
+// Returns the UaServiceField values that differ between [self] and [service].
+guint ua_service_diff(UaService *self, UaService *service) {
+  g_return_val_if_fail(self != NULL, 0);
+  g_return_val_if_fail(service != NULL, 0);
+
+  guint fields = 0;
+  if (g_strcmp0(self->description, service->description) != 0) {
+    fields |= UA_SERVICE_FIELD_DESCRIPTION;
+  }
+  if (value_differs(self->entitled, service->entitled)) {
+    fields |= UA_SERVICE_FIELD_ENTITLED;
+  }
+  if (value_differs(self->status, service->status)) {
+    fields |= UA_SERVICE_FIELD_STATUS;
+  }
+
+  return fields;
+}
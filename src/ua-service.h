@@ -1,11 +1,34 @@
 #pragma once
 
-#include <glib-object.h>
+#include <glib.h>
 
-G_DECLARE_FINAL_TYPE(UaService, ua_service, UA, SERVICE, GObject)
+// A Pro service in a UaStatus snapshot. Services are owned by the snapshot and
+// remain valid for as long as it is referenced.
+typedef struct _UaService UaService;
 
-UaService *ua_service_new(const gchar *name, const gchar *description,
-                          const gchar *entitled, const gchar *status);
+typedef enum {
+  UA_SERVICE_FIELD_DESCRIPTION = 1 << 0,
+  UA_SERVICE_FIELD_ENTITLED = 1 << 1,
+  UA_SERVICE_FIELD_STATUS = 1 << 2,
+  UA_SERVICE_FIELD_ALL = UA_SERVICE_FIELD_DESCRIPTION |
+                         UA_SERVICE_FIELD_ENTITLED | UA_SERVICE_FIELD_STATUS,
+} UaServiceField;
+
+// Entitlement to a service, from the "entitled" field of the Pro status.
+typedef enum {
+  UA_SERVICE_ENTITLEMENT_UNKNOWN,
+  UA_SERVICE_ENTITLEMENT_YES,
+  UA_SERVICE_ENTITLEMENT_NO,
+} UaServiceEntitlement;
+
+// State of a service, from the "status" field of the Pro status.
+typedef enum {
+  UA_SERVICE_STATE_UNKNOWN,
+  UA_SERVICE_STATE_ENABLED,
+  UA_SERVICE_STATE_DISABLED,
+  UA_SERVICE_STATE_NOT_APPLICABLE,
+  UA_SERVICE_STATE_WARNING,
+} UaServiceState;
 
 const gchar *ua_service_get_name(UaService *status);
 
@@ -14,3 +37,11 @@ const gchar *ua_service_get_description(UaService *status);
 const gchar *ua_service_get_entitled(UaService *status);
 
 const gchar *ua_service_get_status(UaService *status);
+
+UaServiceEntitlement ua_service_get_entitlement(UaService *status);
+
+UaServiceState ua_service_get_state(UaService *status);
+
+gboolean ua_service_equal(UaService *service, UaService *other);
+
+guint ua_service_diff(UaService *service, UaService *other);
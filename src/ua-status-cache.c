@@ -0,0 +1,79 @@
+#include "ua-status-cache.h"
+
+// Version of the cache format, increment when changing CACHE_TYPE.
+#define CACHE_VERSION 1
+
+// Version, fingerprint of the status file, attached and services.
+#define CACHE_TYPE "(u(ttts)ba(ssss))"
+
+// Save [status] read from a status file with [fingerprint] to the cache at
+// [path]. The cache is stored in native byte order, as it is only read back
+// on the same machine.
+gboolean ua_status_cache_save(const gchar *path,
+                              UaStatusFingerprint *fingerprint,
+                              UaStatus *status, GError **error) {
+  g_return_val_if_fail(fingerprint->checksum != NULL, FALSE);
+
+  GVariantBuilder services;
+  g_variant_builder_init(&services, G_VARIANT_TYPE("a(ssss)"));
+  for (guint i = 0; i < ua_status_get_n_services(status); i++) {
+    UaService *service = ua_status_get_service_by_index(status, i);
+    g_variant_builder_add(&services, "(ssss)", ua_service_get_name(service),
+                          ua_service_get_description(service),
+                          ua_service_get_entitled(service),
+                          ua_service_get_status(service));
+  }
+
+  g_autoptr(GVariant) cache = g_variant_ref_sink(g_variant_new(
+      CACHE_TYPE, CACHE_VERSION, fingerprint->inode,
+      (guint64)fingerprint->size, fingerprint->mtime, fingerprint->checksum,
+      ua_status_get_attached(status), &services));
+
+  return g_file_set_contents(path, g_variant_get_data(cache),
+                             g_variant_get_size(cache), error);
+}
+
+// Load a status snapshot from the cache at [path], setting [fingerprint] to
+// that of the status file it was read from. The cache is mapped rather than
+// read, so only the values kept in the snapshot are copied.
+UaStatus *ua_status_cache_load(const gchar *path,
+                               UaStatusFingerprint *fingerprint,
+                               GError **error) {
+  g_autoptr(GMappedFile) mapped_file = g_mapped_file_new(path, FALSE, error);
+  if (mapped_file == NULL) {
+    return NULL;
+  }
+  g_autoptr(GBytes) data = g_mapped_file_get_bytes(mapped_file);
+  g_autoptr(GVariant) cache = g_variant_ref_sink(
+      g_variant_new_from_bytes(G_VARIANT_TYPE(CACHE_TYPE), data, FALSE));
+
+  guint32 version;
+  guint64 inode, size, mtime;
+  const gchar *checksum;
+  gboolean attached;
+  g_autoptr(GVariantIter) services = NULL;
+  g_variant_get(cache, "(u(ttt&s)ba(ssss))", &version, &inode, &size, &mtime,
+                &checksum, &attached, &services);
+  if (version != CACHE_VERSION || checksum[0] == '\0') {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                "Unsupported or invalid status cache %s", path);
+    return NULL;
+  }
+
+  g_autoptr(UaStatusBuilder) builder = ua_status_builder_new();
+  ua_status_builder_set_attached(builder, attached);
+  const gchar *name, *description, *entitled, *status;
+  while (g_variant_iter_next(services, "(&s&s&s&s)", &name, &description,
+                             &entitled, &status)) {
+    ua_status_builder_add_service(builder, name, description, entitled,
+                                  status);
+  }
+
+  fingerprint->inode = inode;
+  fingerprint->size = size;
+  fingerprint->mtime = mtime;
+  g_free(fingerprint->checksum);
+  fingerprint->checksum = g_strdup(checksum);
+
+  return ua_status_builder_end(builder);
+}
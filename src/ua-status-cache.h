@@ -0,0 +1,21 @@
+#pragma once
+
+#include <gio/gio.h>
+
+#include "ua-status.h"
+
+// Identifies the contents of a status file.
+typedef struct {
+  guint64 inode;
+  goffset size;
+  guint64 mtime;
+  gchar *checksum;
+} UaStatusFingerprint;
+
+gboolean ua_status_cache_save(const gchar *path,
+                              UaStatusFingerprint *fingerprint,
+                              UaStatus *status, GError **error);
+
+UaStatus *ua_status_cache_load(const gchar *path,
+                               UaStatusFingerprint *fingerprint,
+                               GError **error);
@@ -1,138 +1,608 @@
+#include <errno.h>
+#include <fcntl.h>
 #include <gio/gio.h>
-#include <json-glib/json-glib.h>
+#include <glib/gstdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "config.h"
 #include "ua-service.h"
+#include "ua-status-cache.h"
 #include "ua-status-monitor.h"
+#include "ua-status-parser.h"
+
+// Time to wait for writes to the status file to settle when no
+// CHANGES_DONE_HINT event is received.
+#define STATUS_SETTLE_TIMEOUT_MS 500
+
+// Time to wait for the status file to confirm a provisional status before
+// reverting to the file contents.
+#define PROVISIONAL_TIMEOUT_SECONDS 10
+
+// Request to read the status file in a worker thread.
+typedef struct {
+  GFile *file;
+  gchar *cache_path;
+  UaStatusFingerprint fingerprint;
+  UaStatus *status;
+} ReadData;
+
+// Result of reading the status file. [status] is NULL if unchanged.
+typedef struct {
+  UaStatusFingerprint fingerprint;
+  UaStatus *status;
+} ReadResult;
 
 struct _UaStatusMonitor {
   GObject parent_instance;
 
   GFile *status_file;
-  GFileMonitor *status_file_monitor;
+  GFileMonitor *directory_monitor;
+
+  // Path to the snapshot cache, or NULL if not used.
+  gchar *cache_path;
+
   GCancellable *file_cancellable;
 
+  // Pending timeout to parse the status file once writes have settled.
+  guint settle_timeout_id;
+
+  // TRUE if the status file is currently being parsed.
+  gboolean parsing;
+
+  // TRUE if the status file changed while it was being parsed.
+  gboolean reparse_needed;
+
+  // TRUE once the status file has been read for the first time, and the
+  // tasks waiting for this.
+  gboolean loaded;
+  GList *load_tasks;
+
+  // TRUE if the status was loaded from the cache.
+  gboolean cache_loaded;
+
+  // Tasks waiting for the status file to be reread, and those waiting for the
+  // read in progress to complete. Tasks added during a read wait for the
+  // following one, as the file may have been read before it was changed.
+  GList *refresh_tasks;
+  GList *reading_refresh_tasks;
+
+  // Fingerprint of the last status file read.
+  UaStatusFingerprint fingerprint;
+
+  // Current status snapshot. Snapshots are immutable and replaced as a whole
+  // when the status file changes.
   UaStatus *status;
+
+  // Last status read from the status file, and the number of times it has
+  // changed. This differs from [status] while [provisional] is set.
+  UaStatus *file_status;
+  guint file_serial;
+
+  // TRUE if [status] is a provisional status not yet confirmed by the status
+  // file, and the timeout to revert it.
+  gboolean provisional;
+  guint provisional_timeout_id;
 };
 
 G_DEFINE_TYPE(UaStatusMonitor, ua_status_monitor, G_TYPE_OBJECT)
 
-enum { SIGNAL_CHANGED, SIGNAL_LAST };
+enum {
+  SIGNAL_CHANGED,
+  SIGNAL_ATTACHED_CHANGED,
+  SIGNAL_SERVICE_ADDED,
+  SIGNAL_SERVICE_REMOVED,
+  SIGNAL_SERVICE_CHANGED,
+  SIGNAL_LAST
+};
 
 static guint signals[SIGNAL_LAST] = {0};
 
+enum { PROP_0, PROP_PROVISIONAL, PROP_LAST };
+
+static GParamSpec *properties[PROP_LAST] = {NULL};
+
+static void parse_status_file(UaStatusMonitor *self);
+static void schedule_parse(UaStatusMonitor *self);
+
 static UaStatus *make_empty_status() {
-  g_autoptr(GPtrArray) services =
-      g_ptr_array_new_with_free_func(g_object_unref);
-  return ua_status_new(FALSE, services);
-}
-
-// json_object_get_boolean_member_with_default is only available in
-// json-glib 1.6, reimplemented here for older versions.
-static gboolean get_boolean_member_with_default(JsonObject *object,
-                                                const char *member_name,
-                                                gboolean default_value) {
-  if (json_object_has_member(object, member_name)) {
-    return json_object_get_boolean_member(object, member_name);
-  } else {
-    return default_value;
+  g_autoptr(UaStatusBuilder) builder = ua_status_builder_new();
+  return ua_status_builder_end(builder);
+}
+
+// Called when a parse of the status file has finished, successfully or not.
+static void parse_complete(UaStatusMonitor *self) {
+  self->parsing = FALSE;
+
+  // The file was modified while we were reading it, so read it again to get
+  // the final contents.
+  if (self->reparse_needed) {
+    self->reparse_needed = FALSE;
+    parse_status_file(self);
   }
 }
 
-// json_object_get_string_member_with_default is only available in
-// json-glib 1.6, reimplemented here for older versions.
-static const gchar *get_string_member_with_default(JsonObject *object,
-                                                   const char *member_name,
-                                                   const char *default_value) {
-  if (json_object_has_member(object, member_name)) {
-    return json_object_get_string_member(object, member_name);
-  } else {
-    return default_value;
+static void read_data_free(ReadData *data) {
+  g_clear_object(&data->file);
+  g_clear_pointer(&data->cache_path, g_free);
+  g_clear_pointer(&data->fingerprint.checksum, g_free);
+  g_clear_pointer(&data->status, ua_status_unref);
+  g_free(data);
+}
+
+static void read_result_free(ReadResult *result) {
+  g_clear_pointer(&result->fingerprint.checksum, g_free);
+  g_clear_pointer(&result->status, ua_status_unref);
+  g_free(result);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(ReadResult, read_result_free)
+
+static gboolean fingerprint_stat_equal(UaStatusFingerprint *a,
+                                       UaStatusFingerprint *b) {
+  return a->inode == b->inode && a->size == b->size && a->mtime == b->mtime;
+}
+
+// Set the inode, size and modification time in [fingerprint] from [st].
+static void fingerprint_set_stat(UaStatusFingerprint *fingerprint,
+                                 struct stat *st) {
+  fingerprint->inode = st->st_ino;
+  fingerprint->size = st->st_size;
+  fingerprint->mtime = (guint64)st->st_mtim.tv_sec * G_USEC_PER_SEC +
+                       st->st_mtim.tv_nsec / 1000;
+}
+
+static void return_result(GTask *task, ReadResult *result) {
+  g_task_return_pointer(task, result, (GDestroyNotify)read_result_free);
+}
+
+// Return [status] from [task] if it differs from the current status.
+static void return_status(GTask *task, ReadResult *result, UaStatus *status) {
+  ReadData *data = g_task_get_task_data(task);
+
+  if (!ua_status_equal(data->status, status)) {
+    result->status = ua_status_ref(status);
   }
+  return_result(task, result);
 }
 
-// Called when JSON parsing is complete.
-static void ua_status_parse_cb(GObject *object, GAsyncResult *result,
-                               gpointer user_data) {
-  UaStatusMonitor *self = user_data;
-  JsonParser *parser = JSON_PARSER(object);
+static void return_errno_error(GTask *task, int code, const gchar *message) {
+  g_task_return_new_error(task, G_IO_ERROR, g_io_error_from_errno(code),
+                          "%s: %s", message, g_strerror(code));
+}
+
+// Save [status] read from the status file with [fingerprint] to the cache, so
+// it can be used immediately the next time the daemon starts.
+static void save_cache(ReadData *data, UaStatusFingerprint *fingerprint,
+                       UaStatus *status) {
+  if (data->cache_path == NULL) {
+    return;
+  }
 
   g_autoptr(GError) error = NULL;
-  if (!json_parser_load_from_stream_finish(parser, result, &error)) {
-    g_warning("Failed to parse Pro status: %s", error->message);
+  if (!ua_status_cache_save(data->cache_path, fingerprint, status, &error)) {
+    g_debug("Failed to write status cache: %s", error->message);
+  }
+}
+
+// Read the contents of [fd], expected to be [size] bytes long. The file is
+// read to the end in case it grew after it was checked.
+static gboolean read_contents(int fd, gsize size, gchar **contents,
+                              gsize *length, GError **error) {
+  gsize allocated = size + 1;
+  g_autofree gchar *buffer = g_malloc(allocated);
+  gsize n_read = 0;
+  while (TRUE) {
+    if (n_read == allocated - 1) {
+      allocated *= 2;
+      buffer = g_realloc(buffer, allocated);
+    }
+
+    gssize n = pread(fd, buffer + n_read, allocated - 1 - n_read, n_read);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      int code = errno;
+      g_set_error(error, G_IO_ERROR, g_io_error_from_errno(code),
+                  "Failed to read status file: %s", g_strerror(code));
+      return FALSE;
+    }
+    if (n == 0) {
+      break;
+    }
+    n_read += n;
+  }
+  buffer[n_read] = '\0';
+
+  *contents = g_steal_pointer(&buffer);
+  *length = n_read;
+  return TRUE;
+}
+
+// Check the file open in [fd] still has the metadata in [fingerprint]. pro
+// replaces the file by renaming a new one over it, but if it was instead
+// written in place while being read the contents may be inconsistent. The
+// file monitor will trigger another read once the write has completed.
+static gboolean check_unmodified(int fd, UaStatusFingerprint *fingerprint,
+                                 GError **error) {
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    int code = errno;
+    g_set_error(error, G_IO_ERROR, g_io_error_from_errno(code),
+                "Failed to stat status file: %s", g_strerror(code));
+    return FALSE;
+  }
+  UaStatusFingerprint fingerprint_after;
+  fingerprint_set_stat(&fingerprint_after, &st);
+  if (!fingerprint_stat_equal(fingerprint, &fingerprint_after)) {
+    g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_BUSY,
+                        "Status file modified while being read");
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+// Read and parse the status file open in [fd]. Each stage stops further work
+// if it detects nothing has changed: first the file metadata, then a checksum
+// of the contents, then the parsed values.
+static void read_status_fd(GTask *task, int fd) {
+  ReadData *data = g_task_get_task_data(task);
+  g_autoptr(ReadResult) result = g_new0(ReadResult, 1);
+
+  // Skip reading the file if it is the same file we last read.
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    return_errno_error(task, errno, "Failed to stat status file");
     return;
   }
-  JsonNode *root = json_parser_get_root(parser);
-  if (!JSON_NODE_HOLDS_OBJECT(root)) {
-    g_warning("Invalid Pro status JSON");
+  fingerprint_set_stat(&result->fingerprint, &st);
+  result->fingerprint.checksum = g_strdup(data->fingerprint.checksum);
+  if (data->fingerprint.checksum != NULL &&
+      fingerprint_stat_equal(&result->fingerprint, &data->fingerprint)) {
+    return_result(task, g_steal_pointer(&result));
     return;
   }
-  JsonObject *status = json_node_get_object(root);
 
-  gboolean attached =
-      get_boolean_member_with_default(status, "attached", FALSE);
+  // A file that replaced the one last read is mapped rather than read into a
+  // buffer, so its contents are only copied when the values we use are
+  // extracted. pro replaces the file by renaming a new one over it, and the
+  // mapping stays pinned to the inode opened here, which is never truncated.
+  // If the file is the one last read it has been written in place, and a
+  // mapping would fault if it was truncated while being parsed, so it is read
+  // into a buffer instead.
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GMappedFile) mapped_file = NULL;
+  g_autofree gchar *buffer = NULL;
+  const gchar *contents;
+  gsize contents_length;
+  if ((guint64)st.st_ino != data->fingerprint.inode) {
+    mapped_file = g_mapped_file_new_from_fd(fd, FALSE, &error);
+    if (mapped_file == NULL) {
+      g_task_return_error(task, g_steal_pointer(&error));
+      return;
+    }
+    contents = g_mapped_file_get_contents(mapped_file);
+    contents_length = g_mapped_file_get_length(mapped_file);
+  } else {
+    if (!read_contents(fd, (gsize)st.st_size, &buffer, &contents_length,
+                       &error)) {
+      g_task_return_error(task, g_steal_pointer(&error));
+      return;
+    }
+    contents = buffer;
+  }
 
-  g_autoptr(GPtrArray) services =
-      g_ptr_array_new_with_free_func(g_object_unref);
-  JsonArray *services_array = json_object_get_array_member(status, "services");
-  for (guint i = 0; i < json_array_get_length(services_array); i++) {
-    JsonObject *s = json_array_get_object_element(services_array, i);
+  // The file was rewritten with identical contents. The cache is left as is,
+  // as pro rewrites the file often and the cached snapshot is still correct;
+  // the next start only has to checksum the file again.
+  g_free(result->fingerprint.checksum);
+  result->fingerprint.checksum = g_compute_checksum_for_data(
+      G_CHECKSUM_SHA256, (const guchar *)contents, contents_length);
+  if (g_strcmp0(result->fingerprint.checksum, data->fingerprint.checksum) ==
+      0) {
+    if (!check_unmodified(fd, &result->fingerprint, &error)) {
+      g_task_return_error(task, g_steal_pointer(&error));
+      return;
+    }
+    return_result(task, g_steal_pointer(&result));
+    return;
+  }
 
-    if (g_strcmp0(get_string_member_with_default(s, "available", ""), "yes") !=
-        0) {
-      continue;
+  // A file modified while being parsed may fail to parse, so this is checked
+  // before reporting a parse error.
+  g_autoptr(GError) parse_error = NULL;
+  g_autoptr(UaStatus) status =
+      ua_status_parse(contents, contents_length, &parse_error);
+  if (!check_unmodified(fd, &result->fingerprint, &error)) {
+    g_task_return_error(task, g_steal_pointer(&error));
+    return;
+  }
+  if (status == NULL) {
+    g_task_return_error(task, g_steal_pointer(&parse_error));
+    return;
+  }
+
+  save_cache(data, &result->fingerprint, status);
+  return_status(task, g_steal_pointer(&result), status);
+}
+
+// Read the status file. This runs in a worker thread so slow disks and large
+// files don't block the main loop.
+static void read_status_thread(GTask *task, gpointer source_object,
+                               gpointer task_data, GCancellable *cancellable) {
+  ReadData *data = task_data;
+
+  g_autofree gchar *path = g_file_get_path(data->file);
+  int fd = g_open(path, O_RDONLY | O_CLOEXEC, 0);
+  if (fd < 0) {
+    if (errno == ENOENT) {
+      g_autoptr(UaStatus) status = make_empty_status();
+      return_status(task, g_new0(ReadResult, 1), status);
+    } else {
+      return_errno_error(task, errno, "Failed to open status file");
+    }
+    return;
+  }
+
+  read_status_fd(task, fd);
+  g_close(fd, NULL);
+}
+
+// Complete the tasks waiting for the status file to be read for the first
+// time.
+static void complete_load(UaStatusMonitor *self) {
+  if (self->loaded) {
+    return;
+  }
+  self->loaded = TRUE;
+
+  GList *tasks = self->load_tasks;
+  self->load_tasks = NULL;
+  for (GList *link = tasks; link != NULL; link = link->next) {
+    g_autoptr(GTask) task = link->data;
+    g_task_return_boolean(task, TRUE);
+  }
+  g_list_free(tasks);
+}
+
+// Complete [tasks] waiting for a refresh with [error], or successfully if
+// [error] is NULL.
+static void complete_refresh(GList *tasks, const GError *error) {
+  for (GList *link = tasks; link != NULL; link = link->next) {
+    g_autoptr(GTask) task = link->data;
+    if (error != NULL) {
+      g_task_return_error(task, g_error_copy(error));
+    } else {
+      g_task_return_boolean(task, TRUE);
     }
+  }
+  g_list_free(tasks);
+}
+
+// Emit signals for the differences between [old_status] and [new_status].
+static void emit_changes(UaStatusMonitor *self, UaStatus *old_status,
+                         UaStatus *new_status) {
+  gboolean attached = ua_status_get_attached(new_status);
+  if (ua_status_get_attached(old_status) != attached) {
+    g_signal_emit(self, signals[SIGNAL_ATTACHED_CHANGED], 0, attached);
+  }
 
-    g_ptr_array_add(
-        services,
-        ua_service_new(get_string_member_with_default(s, "name", ""),
-                       get_string_member_with_default(s, "description", ""),
-                       get_string_member_with_default(s, "entitled", ""),
-                       get_string_member_with_default(s, "status", "")));
+  for (guint i = 0; i < ua_status_get_n_services(old_status); i++) {
+    UaService *service = ua_status_get_service_by_index(old_status, i);
+    if (ua_status_get_service(new_status, ua_service_get_name(service)) ==
+        NULL) {
+      g_signal_emit(self, signals[SIGNAL_SERVICE_REMOVED], 0, service);
+    }
   }
 
-  g_clear_object(&self->status);
-  self->status = ua_status_new(attached, services);
+  for (guint i = 0; i < ua_status_get_n_services(new_status); i++) {
+    UaService *service = ua_status_get_service_by_index(new_status, i);
+    UaService *old_service =
+        ua_status_get_service(old_status, ua_service_get_name(service));
+    if (old_service == NULL) {
+      g_signal_emit(self, signals[SIGNAL_SERVICE_ADDED], 0, service);
+    } else {
+      guint changed_fields = ua_service_diff(old_service, service);
+      if (changed_fields != 0) {
+        g_signal_emit(self, signals[SIGNAL_SERVICE_CHANGED], 0, service,
+                      changed_fields);
+      }
+    }
+  }
 
   g_signal_emit(self, signals[SIGNAL_CHANGED], 0);
 }
 
-static void parse_status_file(UaStatusMonitor *self) {
-  if (self->file_cancellable != NULL) {
-    g_cancellable_cancel(self->file_cancellable);
+// Replace the current status with [status] and emit the changes.
+static void publish_status(UaStatusMonitor *self, UaStatus *status) {
+  if (ua_status_equal(self->status, status)) {
+    return;
+  }
+
+  // Only the main context replaces the snapshot, so readers never wait on the
+  // worker thread.
+  g_autoptr(UaStatus) old_status = g_atomic_pointer_get(&self->status);
+  g_atomic_pointer_set(&self->status, ua_status_ref(status));
+
+  emit_changes(self, old_status, status);
+}
+
+// Mark if the current status is provisional.
+static void set_provisional(UaStatusMonitor *self, gboolean provisional) {
+  if (self->provisional_timeout_id != 0) {
+    g_source_remove(self->provisional_timeout_id);
+    self->provisional_timeout_id = 0;
   }
-  g_clear_object(&self->file_cancellable);
-  self->file_cancellable = g_cancellable_new();
+
+  if (self->provisional == provisional) {
+    return;
+  }
+  self->provisional = provisional;
+  g_object_notify_by_pspec(G_OBJECT(self), properties[PROP_PROVISIONAL]);
+}
+
+// Called when the status file has been read in the worker thread.
+static void read_status_cb(GObject *object, GAsyncResult *result,
+                           gpointer user_data) {
+  UaStatusMonitor *self = UA_STATUS_MONITOR(object);
+
+  // Complete the refreshes waiting for this read once it has been applied.
+  GList *refresh_tasks = self->reading_refresh_tasks;
+  self->reading_refresh_tasks = NULL;
 
   g_autoptr(GError) error = NULL;
-  g_autoptr(GFileInputStream) stream =
-      g_file_read(self->status_file, self->file_cancellable, &error);
-  if (stream == NULL) {
-    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND)) {
-      g_clear_object(&self->status);
-      self->status = make_empty_status();
-      g_signal_emit(self, signals[SIGNAL_CHANGED], 0);
-    } else {
-      g_printerr("Failed to read Pro status file: %s\n", error->message);
+  ReadResult *r = g_task_propagate_pointer(G_TASK(result), &error);
+  if (r == NULL) {
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+      complete_refresh(refresh_tasks, error);
+      return;
+    }
+
+    // Read the file again next time it changes, even if the metadata matches.
+    // The inode is kept, so a file being written in place isn't mapped.
+    self->fingerprint.size = 0;
+    self->fingerprint.mtime = 0;
+
+    // If it was being written to, read it again once the write has settled,
+    // or sooner if the monitor reports it complete. The load and refreshes
+    // complete when that is done, as the status read so far is stale.
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_BUSY)) {
+      self->refresh_tasks = g_list_concat(refresh_tasks, self->refresh_tasks);
+      if (!self->reparse_needed && self->settle_timeout_id == 0) {
+        schedule_parse(self);
+      }
+      parse_complete(self);
+      return;
     }
+
+    g_warning("Failed to read Pro status: %s", error->message);
+    parse_complete(self);
+    complete_load(self);
+    complete_refresh(refresh_tasks, error);
     return;
   }
 
-  g_autoptr(JsonParser) parser = json_parser_new();
-  json_parser_load_from_stream_async(parser, G_INPUT_STREAM(stream),
-                                     self->file_cancellable, ua_status_parse_cb,
-                                     self);
+  g_free(self->fingerprint.checksum);
+  self->fingerprint = r->fingerprint;
+  r->fingerprint.checksum = NULL;
+  g_autoptr(UaStatus) status = g_steal_pointer(&r->status);
+  read_result_free(r);
+
+  parse_complete(self);
+
+  // The status file is rewritten after each change, so any provisional status
+  // is replaced by what was actually written.
+  if (status != NULL) {
+    g_clear_pointer(&self->file_status, ua_status_unref);
+    self->file_status = ua_status_ref(status);
+    self->file_serial++;
+    set_provisional(self, FALSE);
+    publish_status(self, status);
+  }
+
+  complete_load(self);
+  complete_refresh(refresh_tasks, NULL);
+}
+
+// Read the status file in a worker thread and update the status if it has
+// changed.
+static void parse_status_file(UaStatusMonitor *self) {
+  self->parsing = TRUE;
+  self->reading_refresh_tasks =
+      g_list_concat(self->reading_refresh_tasks, self->refresh_tasks);
+  self->refresh_tasks = NULL;
+
+  ReadData *data = g_new0(ReadData, 1);
+  data->file = g_object_ref(self->status_file);
+  data->cache_path = g_strdup(self->cache_path);
+  data->fingerprint = self->fingerprint;
+  data->fingerprint.checksum = g_strdup(self->fingerprint.checksum);
+  data->status = ua_status_ref(self->file_status);
+
+  g_autoptr(GTask) task =
+      g_task_new(self, self->file_cancellable, read_status_cb, NULL);
+  g_task_set_task_data(task, data, (GDestroyNotify)read_data_free);
+  g_task_run_in_thread(task, read_status_thread);
 }
 
-static void status_file_changed_cb(UaStatusMonitor *self, GFile *file,
-                                   GFile *other_file,
-                                   GFileMonitorEvent event_type) {
-  if (event_type == G_FILE_MONITOR_EVENT_CHANGED ||
-      event_type == G_FILE_MONITOR_EVENT_DELETED) {
+// Parse the status file now, or once the current parse completes.
+static void queue_parse(UaStatusMonitor *self) {
+  if (self->settle_timeout_id != 0) {
+    g_source_remove(self->settle_timeout_id);
+    self->settle_timeout_id = 0;
+  }
+
+  if (self->parsing) {
+    self->reparse_needed = TRUE;
+  } else {
     parse_status_file(self);
   }
 }
 
+// Called when writes to the status file have settled.
+static gboolean settle_timeout_cb(gpointer user_data) {
+  UaStatusMonitor *self = user_data;
+
+  self->settle_timeout_id = 0;
+  queue_parse(self);
+
+  return G_SOURCE_REMOVE;
+}
+
+// Parse the status file once no more changes have occurred for a while.
+static void schedule_parse(UaStatusMonitor *self) {
+  if (self->settle_timeout_id != 0) {
+    g_source_remove(self->settle_timeout_id);
+  }
+  self->settle_timeout_id =
+      g_timeout_add(STATUS_SETTLE_TIMEOUT_MS, settle_timeout_cb, self);
+}
+
+static gboolean is_status_file(UaStatusMonitor *self, GFile *file) {
+  return file != NULL && g_file_equal(file, self->status_file);
+}
+
+// Called when a file in the directory containing the status file changes.
+// A single write of the status file generates a burst of events, so these are
+// coalesced into one parse once the write is complete. The status file is
+// normally replaced by renaming a temporary file over it, which is only seen
+// by monitoring the directory.
+static void directory_changed_cb(UaStatusMonitor *self, GFile *file,
+                                 GFile *other_file,
+                                 GFileMonitorEvent event_type) {
+  switch (event_type) {
+  case G_FILE_MONITOR_EVENT_CHANGED:
+  case G_FILE_MONITOR_EVENT_CREATED:
+  case G_FILE_MONITOR_EVENT_DELETED:
+  case G_FILE_MONITOR_EVENT_MOVED_OUT:
+    // The file is being written, wait for it to complete.
+    if (is_status_file(self, file)) {
+      schedule_parse(self);
+    }
+    break;
+  case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+  case G_FILE_MONITOR_EVENT_MOVED_IN:
+    // The file has been completely written.
+    if (is_status_file(self, file)) {
+      queue_parse(self);
+    }
+    break;
+  case G_FILE_MONITOR_EVENT_RENAMED:
+    if (is_status_file(self, other_file)) {
+      // A complete file has been moved into place.
+      queue_parse(self);
+    } else if (is_status_file(self, file)) {
+      // The file has been moved away, and may be replaced.
+      schedule_parse(self);
+    }
+    break;
+  default:
+    break;
+  }
+}
+
 static void ua_status_monitor_dispose(GObject *object) {
   UaStatusMonitor *self = UA_STATUS_MONITOR(object);
 
@@ -140,51 +610,254 @@ static void ua_status_monitor_dispose(GObject *object) {
     g_cancellable_cancel(self->file_cancellable);
   }
 
+  if (self->settle_timeout_id != 0) {
+    g_source_remove(self->settle_timeout_id);
+    self->settle_timeout_id = 0;
+  }
+
+  for (GList *link = self->load_tasks; link != NULL; link = link->next) {
+    g_autoptr(GTask) task = link->data;
+    g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                            "Status monitor destroyed");
+  }
+  g_clear_pointer(&self->load_tasks, g_list_free);
+
+  g_autoptr(GError) error = g_error_new_literal(
+      G_IO_ERROR, G_IO_ERROR_CANCELLED, "Status monitor destroyed");
+  complete_refresh(self->refresh_tasks, error);
+  self->refresh_tasks = NULL;
+  complete_refresh(self->reading_refresh_tasks, error);
+  self->reading_refresh_tasks = NULL;
+
+  if (self->provisional_timeout_id != 0) {
+    g_source_remove(self->provisional_timeout_id);
+    self->provisional_timeout_id = 0;
+  }
+
   g_clear_object(&self->status_file);
-  g_clear_object(&self->status_file_monitor);
-  g_clear_object(&self->status);
+  g_clear_object(&self->directory_monitor);
+  g_clear_pointer(&self->cache_path, g_free);
+  g_clear_pointer(&self->status, ua_status_unref);
+  g_clear_pointer(&self->file_status, ua_status_unref);
   g_clear_object(&self->file_cancellable);
+  g_clear_pointer(&self->fingerprint.checksum, g_free);
 
   G_OBJECT_CLASS(ua_status_monitor_parent_class)->dispose(object);
 }
 
 static void ua_status_monitor_init(UaStatusMonitor *self) {
+  self->file_cancellable = g_cancellable_new();
   self->status = make_empty_status();
+  self->file_status = ua_status_ref(self->status);
+}
+
+static void ua_status_monitor_get_property(GObject *object, guint prop_id,
+                                           GValue *value, GParamSpec *pspec) {
+  UaStatusMonitor *self = UA_STATUS_MONITOR(object);
+
+  switch (prop_id) {
+  case PROP_PROVISIONAL:
+    g_value_set_boolean(value, self->provisional);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
 }
 
 static void ua_status_monitor_class_init(UaStatusMonitorClass *klass) {
-  G_OBJECT_CLASS(klass)->dispose = ua_status_monitor_dispose;
+  GObjectClass *object_class = G_OBJECT_CLASS(klass);
+
+  object_class->dispose = ua_status_monitor_dispose;
+  object_class->get_property = ua_status_monitor_get_property;
 
+  properties[PROP_PROVISIONAL] =
+      g_param_spec_boolean("provisional", NULL, NULL, FALSE,
+                           G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_properties(object_class, PROP_LAST, properties);
+
+  // Emitted after all the signals below have been emitted for a change.
   signals[SIGNAL_CHANGED] =
       g_signal_new("changed", G_TYPE_FROM_CLASS(G_OBJECT_CLASS(klass)),
                    G_SIGNAL_RUN_LAST, 0, NULL, NULL, NULL, G_TYPE_NONE, 0);
+  signals[SIGNAL_ATTACHED_CHANGED] = g_signal_new(
+      "attached-changed", G_TYPE_FROM_CLASS(G_OBJECT_CLASS(klass)),
+      G_SIGNAL_RUN_LAST, 0, NULL, NULL, NULL, G_TYPE_NONE, 1, G_TYPE_BOOLEAN);
+  // Services are passed as pointers into the status snapshot, and are only
+  // valid for the duration of the emission.
+  signals[SIGNAL_SERVICE_ADDED] = g_signal_new(
+      "service-added", G_TYPE_FROM_CLASS(G_OBJECT_CLASS(klass)),
+      G_SIGNAL_RUN_LAST, 0, NULL, NULL, NULL, G_TYPE_NONE, 1, G_TYPE_POINTER);
+  signals[SIGNAL_SERVICE_REMOVED] = g_signal_new(
+      "service-removed", G_TYPE_FROM_CLASS(G_OBJECT_CLASS(klass)),
+      G_SIGNAL_RUN_LAST, 0, NULL, NULL, NULL, G_TYPE_NONE, 1, G_TYPE_POINTER);
+  // Emitted with the new service and the UaServiceField values that changed.
+  signals[SIGNAL_SERVICE_CHANGED] = g_signal_new(
+      "service-changed", G_TYPE_FROM_CLASS(G_OBJECT_CLASS(klass)),
+      G_SIGNAL_RUN_LAST, 0, NULL, NULL, NULL, G_TYPE_NONE, 2, G_TYPE_POINTER,
+      G_TYPE_UINT);
 }
 
-UaStatusMonitor *ua_status_monitor_new(const char *path) {
+// Create a monitor for the status file at [path]. If [cache_path] is not NULL
+// the last status read is cached there.
+UaStatusMonitor *ua_status_monitor_new(const char *path,
+                                       const char *cache_path) {
   UaStatusMonitor *self = g_object_new(ua_status_monitor_get_type(), NULL);
   self->status_file = g_file_new_for_path(path);
+  self->cache_path = g_strdup(cache_path);
 
   return self;
 }
 
+// Use the cached status until the status file has been read.
+static void load_cache(UaStatusMonitor *self) {
+  g_autoptr(GError) error = NULL;
+  UaStatus *status =
+      ua_status_cache_load(self->cache_path, &self->fingerprint, &error);
+  if (status == NULL) {
+    if (!g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+      g_warning("Failed to load status cache: %s", error->message);
+    }
+    return;
+  }
+
+  g_clear_pointer(&self->status, ua_status_unref);
+  self->status = status;
+  g_clear_pointer(&self->file_status, ua_status_unref);
+  self->file_status = ua_status_ref(status);
+  self->cache_loaded = TRUE;
+}
+
 gboolean ua_status_monitor_start(UaStatusMonitor *self, GError **error) {
   g_return_val_if_fail(UA_IS_STATUS_MONITOR(self), FALSE);
-  self->status_file_monitor =
-      g_file_monitor_file(self->status_file, G_FILE_MONITOR_NONE, NULL, error);
-  if (self->status_file_monitor == NULL) {
+  g_autoptr(GFile) directory = g_file_get_parent(self->status_file);
+  self->directory_monitor = g_file_monitor_directory(
+      directory, G_FILE_MONITOR_WATCH_MOVES, NULL, error);
+  if (self->directory_monitor == NULL) {
     return FALSE;
   } else {
-    g_signal_connect_swapped(self->status_file_monitor, "changed",
-                             G_CALLBACK(status_file_changed_cb), self);
+    g_signal_connect_swapped(self->directory_monitor, "changed",
+                             G_CALLBACK(directory_changed_cb), self);
+  }
+
+  // Start with the cached status, so it can be used immediately. Reading the
+  // status file then confirms it is still current using the fingerprint.
+  if (self->cache_path != NULL) {
+    load_cache(self);
   }
 
   // Read initial status.
-  parse_status_file(self);
+  queue_parse(self);
 
   return TRUE;
 }
 
+// Gets the current status snapshot. This never blocks on the status file
+// being read. The snapshot is immutable and remains valid until the next
+// "changed" signal.
 UaStatus *ua_status_monitor_get_status(UaStatusMonitor *self) {
   g_return_val_if_fail(UA_IS_STATUS_MONITOR(self), NULL);
-  return self->status;
+  return g_atomic_pointer_get(&self->status);
+}
+
+// Returns TRUE if the status is known, either from the cache or from reading
+// the status file. Until then the status is empty.
+gboolean ua_status_monitor_has_status(UaStatusMonitor *self) {
+  g_return_val_if_fail(UA_IS_STATUS_MONITOR(self), FALSE);
+  return self->cache_loaded || self->loaded;
+}
+
+// Wait until the status file has been read for the first time, so the status
+// is known to be current. Completes immediately if already read.
+void ua_status_monitor_wait_loaded(UaStatusMonitor *self,
+                                   GCancellable *cancellable,
+                                   GAsyncReadyCallback callback,
+                                   gpointer callback_data) {
+  g_return_if_fail(UA_IS_STATUS_MONITOR(self));
+
+  g_autoptr(GTask) task =
+      g_task_new(self, cancellable, callback, callback_data);
+  if (self->loaded) {
+    g_task_return_boolean(task, TRUE);
+    return;
+  }
+
+  self->load_tasks = g_list_append(self->load_tasks, g_steal_pointer(&task));
+}
+
+// Complete request started with ua_status_monitor_wait_loaded().
+gboolean ua_status_monitor_wait_loaded_finish(UaStatusMonitor *self,
+                                              GAsyncResult *result,
+                                              GError **error) {
+  return g_task_propagate_boolean(G_TASK(result), error);
+}
+
+// Called when the status file has not confirmed a provisional status in time.
+static gboolean provisional_timeout_cb(gpointer user_data) {
+  UaStatusMonitor *self = user_data;
+
+  self->provisional_timeout_id = 0;
+  g_debug("Provisional status not confirmed, reverting to status file");
+  set_provisional(self, FALSE);
+  publish_status(self, self->file_status);
+  queue_parse(self);
+
+  return G_SOURCE_REMOVE;
+}
+
+// Gets a number that increases each time a change is read from the status
+// file.
+guint ua_status_monitor_get_file_serial(UaStatusMonitor *self) {
+  g_return_val_if_fail(UA_IS_STATUS_MONITOR(self), 0);
+  return self->file_serial;
+}
+
+// Use [status] as the current status until the status file is next changed.
+// This is used to show the result of a pro command without waiting for the
+// status file to be rewritten. It is ignored if the status file has changed
+// since [file_serial] was read, as the file may already contain the result.
+void ua_status_monitor_set_provisional_status(UaStatusMonitor *self,
+                                              UaStatus *status,
+                                              guint file_serial) {
+  g_return_if_fail(UA_IS_STATUS_MONITOR(self));
+  g_return_if_fail(status != NULL);
+
+  if (file_serial != self->file_serial ||
+      ua_status_equal(self->status, status)) {
+    return;
+  }
+
+  set_provisional(self, TRUE);
+  self->provisional_timeout_id = g_timeout_add_seconds(
+      PROVISIONAL_TIMEOUT_SECONDS, provisional_timeout_cb, self);
+  publish_status(self, status);
+}
+
+// Returns TRUE if the current status was set with
+// ua_status_monitor_set_provisional_status() and not yet confirmed by the
+// status file.
+gboolean ua_status_monitor_get_provisional(UaStatusMonitor *self) {
+  g_return_val_if_fail(UA_IS_STATUS_MONITOR(self), FALSE);
+  return self->provisional;
+}
+
+// Read the status file now, without waiting for it to be reported as changed.
+// Completes once the status read has been applied, so the status reflects
+// any changes made to the file before this was called.
+void ua_status_monitor_refresh(UaStatusMonitor *self,
+                               GCancellable *cancellable,
+                               GAsyncReadyCallback callback,
+                               gpointer callback_data) {
+  g_return_if_fail(UA_IS_STATUS_MONITOR(self));
+
+  GTask *task = g_task_new(self, cancellable, callback, callback_data);
+  self->refresh_tasks = g_list_append(self->refresh_tasks, task);
+  queue_parse(self);
+}
+
+// Complete request started with ua_status_monitor_refresh().
+gboolean ua_status_monitor_refresh_finish(UaStatusMonitor *self,
+                                          GAsyncResult *result,
+                                          GError **error) {
+  return g_task_propagate_boolean(G_TASK(result), error);
 }
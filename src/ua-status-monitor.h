@@ -1,14 +1,43 @@
 #pragma once
 
-#include <glib-object.h>
+#include <gio/gio.h>
 
 #include "ua-status.h"
 
 G_DECLARE_FINAL_TYPE(UaStatusMonitor, ua_status_monitor, UA, STATUS_MONITOR,
                      GObject)
 
-UaStatusMonitor *ua_status_monitor_new(const char *filename);
+UaStatusMonitor *ua_status_monitor_new(const char *filename,
+                                       const char *cache_path);
 
 gboolean ua_status_monitor_start(UaStatusMonitor *monitor, GError **error);
 
 UaStatus *ua_status_monitor_get_status(UaStatusMonitor *monitor);
+
+gboolean ua_status_monitor_has_status(UaStatusMonitor *monitor);
+
+void ua_status_monitor_wait_loaded(UaStatusMonitor *monitor,
+                                   GCancellable *cancellable,
+                                   GAsyncReadyCallback callback,
+                                   gpointer callback_data);
+
+gboolean ua_status_monitor_wait_loaded_finish(UaStatusMonitor *monitor,
+                                              GAsyncResult *result,
+                                              GError **error);
+
+guint ua_status_monitor_get_file_serial(UaStatusMonitor *monitor);
+
+void ua_status_monitor_set_provisional_status(UaStatusMonitor *monitor,
+                                              UaStatus *status,
+                                              guint file_serial);
+
+gboolean ua_status_monitor_get_provisional(UaStatusMonitor *monitor);
+
+void ua_status_monitor_refresh(UaStatusMonitor *monitor,
+                               GCancellable *cancellable,
+                               GAsyncReadyCallback callback,
+                               gpointer callback_data);
+
+gboolean ua_status_monitor_refresh_finish(UaStatusMonitor *monitor,
+                                          GAsyncResult *result,
+                                          GError **error);
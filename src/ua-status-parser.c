@@ -0,0 +1,436 @@
+#include <gio/gio.h>
+#include <string.h>
+
+#include "ua-status-parser.h"
+
+// Maximum nesting of JSON values, to limit recursion on malformed input.
+#define MAX_DEPTH 64
+
+// A pull parser for the Pro status JSON. Only the values the daemon uses are
+// decoded, everything else is skipped over in place.
+typedef struct {
+  const gchar *data;
+  const gchar *end;
+  const gchar *p;
+  GError **error;
+
+  // Scratch buffer for the current object member name.
+  GString *member_name;
+
+  // Values read from the current service.
+  GString *name;
+  GString *description;
+  GString *entitled;
+  GString *status;
+  GString *available;
+
+  UaStatusBuilder *builder;
+} StatusParser;
+
+typedef gboolean (*MemberFunction)(StatusParser *parser, const gchar *name,
+                                   guint depth);
+typedef gboolean (*ElementFunction)(StatusParser *parser, guint depth);
+
+static gboolean skip_value(StatusParser *parser, guint depth);
+static gboolean skip_member(StatusParser *parser, const gchar *name,
+                            guint depth);
+
+static gboolean parse_error(StatusParser *parser, const gchar *message) {
+  g_set_error(parser->error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+              "Invalid Pro status JSON at offset %" G_GSIZE_FORMAT ": %s",
+              (gsize)(parser->p - parser->data), message);
+  return FALSE;
+}
+
+static void skip_whitespace(StatusParser *parser) {
+  while (parser->p < parser->end &&
+         (*parser->p == ' ' || *parser->p == '\t' || *parser->p == '\n' ||
+          *parser->p == '\r')) {
+    parser->p++;
+  }
+}
+
+// Returns TRUE if the next token starts with [c].
+static gboolean peek(StatusParser *parser, gchar c) {
+  skip_whitespace(parser);
+  return parser->p < parser->end && *parser->p == c;
+}
+
+// Consume the next token if it is [c].
+static gboolean consume(StatusParser *parser, gchar c) {
+  if (!peek(parser, c)) {
+    return FALSE;
+  }
+  parser->p++;
+  return TRUE;
+}
+
+static gboolean read_hex4(StatusParser *parser, gunichar *value) {
+  if (parser->end - parser->p < 4) {
+    return parse_error(parser, "truncated unicode escape");
+  }
+
+  *value = 0;
+  for (int i = 0; i < 4; i++) {
+    int digit = g_ascii_xdigit_value(parser->p[i]);
+    if (digit < 0) {
+      return parse_error(parser, "invalid unicode escape");
+    }
+    *value = (*value << 4) | digit;
+  }
+  parser->p += 4;
+
+  return TRUE;
+}
+
+// Read a \uXXXX escape sequence, including a following low surrogate if
+// required.
+static gboolean read_unicode_escape(StatusParser *parser, gunichar *value) {
+  if (!read_hex4(parser, value)) {
+    return FALSE;
+  }
+
+  if (*value >= 0xdc00 && *value <= 0xdfff) {
+    return parse_error(parser, "unexpected low surrogate");
+  }
+
+  if (*value >= 0xd800 && *value <= 0xdbff) {
+    gunichar low_surrogate;
+    if (parser->end - parser->p < 2 || parser->p[0] != '\\' ||
+        parser->p[1] != 'u') {
+      return parse_error(parser, "missing low surrogate");
+    }
+    parser->p += 2;
+    if (!read_hex4(parser, &low_surrogate)) {
+      return FALSE;
+    }
+    if (low_surrogate < 0xdc00 || low_surrogate > 0xdfff) {
+      return parse_error(parser, "invalid low surrogate");
+    }
+    *value = 0x10000 + ((*value - 0xd800) << 10) + (low_surrogate - 0xdc00);
+  }
+
+  if (*value == 0) {
+    return parse_error(parser, "NUL character in string");
+  }
+
+  return TRUE;
+}
+
+// Read a string, appending the decoded value to [value]. If [value] is NULL
+// the string is skipped.
+static gboolean read_string(StatusParser *parser, GString *value) {
+  if (!consume(parser, '"')) {
+    return parse_error(parser, "expected string");
+  }
+
+  while (TRUE) {
+    // Copy unescaped characters in one block.
+    const gchar *start = parser->p;
+    while (parser->p < parser->end && *parser->p != '"' &&
+           *parser->p != '\\' && (guchar)*parser->p >= 0x20) {
+      parser->p++;
+    }
+    if (value != NULL) {
+      if (!g_utf8_validate(start, parser->p - start, NULL)) {
+        return parse_error(parser, "invalid UTF-8 in string");
+      }
+      g_string_append_len(value, start, parser->p - start);
+    }
+
+    if (parser->p >= parser->end) {
+      return parse_error(parser, "unterminated string");
+    }
+    if (*parser->p == '"') {
+      parser->p++;
+      return TRUE;
+    }
+    if (*parser->p != '\\') {
+      return parse_error(parser, "control character in string");
+    }
+    parser->p++;
+    if (parser->p >= parser->end) {
+      return parse_error(parser, "unterminated string");
+    }
+
+    gunichar c;
+    switch (*parser->p++) {
+    case '"':
+      c = '"';
+      break;
+    case '\\':
+      c = '\\';
+      break;
+    case '/':
+      c = '/';
+      break;
+    case 'b':
+      c = '\b';
+      break;
+    case 'f':
+      c = '\f';
+      break;
+    case 'n':
+      c = '\n';
+      break;
+    case 'r':
+      c = '\r';
+      break;
+    case 't':
+      c = '\t';
+      break;
+    case 'u':
+      // Skipped strings only need to be well formed, so the code point is
+      // only checked if the string is being decoded.
+      if (value == NULL) {
+        if (!read_hex4(parser, &c)) {
+          return FALSE;
+        }
+      } else if (!read_unicode_escape(parser, &c)) {
+        return FALSE;
+      }
+      break;
+    default:
+      return parse_error(parser, "invalid escape sequence");
+    }
+    if (value != NULL) {
+      g_string_append_unichar(value, c);
+    }
+  }
+}
+
+// Read a string into [value] if the next value is a string, otherwise skip it
+// and leave [value] empty.
+static gboolean read_optional_string(StatusParser *parser, GString *value,
+                                     guint depth) {
+  g_string_truncate(value, 0);
+  if (peek(parser, '"')) {
+    return read_string(parser, value);
+  } else {
+    return skip_value(parser, depth);
+  }
+}
+
+static gboolean read_literal(StatusParser *parser, const gchar *literal) {
+  gsize length = strlen(literal);
+  if ((gsize)(parser->end - parser->p) < length ||
+      strncmp(parser->p, literal, length) != 0) {
+    return parse_error(parser, "unexpected character");
+  }
+  parser->p += length;
+
+  return TRUE;
+}
+
+static gboolean skip_number(StatusParser *parser) {
+  const gchar *start = parser->p;
+  while (parser->p < parser->end &&
+         (g_ascii_isdigit(*parser->p) || *parser->p == '-' ||
+          *parser->p == '+' || *parser->p == '.' || *parser->p == 'e' ||
+          *parser->p == 'E')) {
+    parser->p++;
+  }
+  if (parser->p == start) {
+    return parse_error(parser, "unexpected character");
+  }
+
+  return TRUE;
+}
+
+// Read an object, calling [member_function] with the name of each member. The
+// function must consume the member value.
+static gboolean read_object(StatusParser *parser, guint depth,
+                            MemberFunction member_function) {
+  if (!consume(parser, '{')) {
+    return parse_error(parser, "expected object");
+  }
+  if (consume(parser, '}')) {
+    return TRUE;
+  }
+
+  // Member names of skipped objects aren't needed, so aren't decoded.
+  GString *member_name =
+      member_function == skip_member ? NULL : parser->member_name;
+  do {
+    g_string_truncate(parser->member_name, 0);
+    if (!read_string(parser, member_name)) {
+      return FALSE;
+    }
+    if (!consume(parser, ':')) {
+      return parse_error(parser, "expected ':'");
+    }
+    if (!member_function(parser, parser->member_name->str, depth + 1)) {
+      return FALSE;
+    }
+  } while (consume(parser, ','));
+
+  if (!consume(parser, '}')) {
+    return parse_error(parser, "expected ',' or '}'");
+  }
+
+  return TRUE;
+}
+
+// Read an array, calling [element_function] to consume each element.
+static gboolean read_array(StatusParser *parser, guint depth,
+                           ElementFunction element_function) {
+  if (!consume(parser, '[')) {
+    return parse_error(parser, "expected array");
+  }
+  if (consume(parser, ']')) {
+    return TRUE;
+  }
+
+  do {
+    if (!element_function(parser, depth + 1)) {
+      return FALSE;
+    }
+  } while (consume(parser, ','));
+
+  if (!consume(parser, ']')) {
+    return parse_error(parser, "expected ',' or ']'");
+  }
+
+  return TRUE;
+}
+
+static gboolean skip_member(StatusParser *parser, const gchar *name,
+                            guint depth) {
+  return skip_value(parser, depth);
+}
+
+static gboolean skip_element(StatusParser *parser, guint depth) {
+  return skip_value(parser, depth);
+}
+
+// Skip over a value of any type without decoding it.
+static gboolean skip_value(StatusParser *parser, guint depth) {
+  if (depth > MAX_DEPTH) {
+    return parse_error(parser, "values nested too deeply");
+  }
+
+  skip_whitespace(parser);
+  if (parser->p >= parser->end) {
+    return parse_error(parser, "unexpected end of data");
+  }
+
+  switch (*parser->p) {
+  case '"':
+    return read_string(parser, NULL);
+  case '{':
+    return read_object(parser, depth, skip_member);
+  case '[':
+    return read_array(parser, depth, skip_element);
+  case 't':
+    return read_literal(parser, "true");
+  case 'f':
+    return read_literal(parser, "false");
+  case 'n':
+    return read_literal(parser, "null");
+  default:
+    return skip_number(parser);
+  }
+}
+
+// Called for each member of a service object.
+static gboolean service_member(StatusParser *parser, const gchar *name,
+                               guint depth) {
+  if (strcmp(name, "name") == 0) {
+    return read_optional_string(parser, parser->name, depth);
+  } else if (strcmp(name, "description") == 0) {
+    return read_optional_string(parser, parser->description, depth);
+  } else if (strcmp(name, "entitled") == 0) {
+    return read_optional_string(parser, parser->entitled, depth);
+  } else if (strcmp(name, "status") == 0) {
+    return read_optional_string(parser, parser->status, depth);
+  } else if (strcmp(name, "available") == 0) {
+    return read_optional_string(parser, parser->available, depth);
+  } else {
+    return skip_value(parser, depth);
+  }
+}
+
+// Called for each element of the services array.
+static gboolean service_element(StatusParser *parser, guint depth) {
+  if (!peek(parser, '{')) {
+    return skip_value(parser, depth);
+  }
+
+  g_string_truncate(parser->name, 0);
+  g_string_truncate(parser->description, 0);
+  g_string_truncate(parser->entitled, 0);
+  g_string_truncate(parser->status, 0);
+  g_string_truncate(parser->available, 0);
+  if (!read_object(parser, depth, service_member)) {
+    return FALSE;
+  }
+
+  if (strcmp(parser->available->str, "yes") == 0) {
+    ua_status_builder_add_service(parser->builder, parser->name->str,
+                                  parser->description->str,
+                                  parser->entitled->str, parser->status->str);
+  }
+
+  return TRUE;
+}
+
+// Called for each member of the top level status object.
+static gboolean status_member(StatusParser *parser, const gchar *name,
+                              guint depth) {
+  if (strcmp(name, "attached") == 0) {
+    ua_status_builder_set_attached(parser->builder, FALSE);
+    if (peek(parser, 't')) {
+      ua_status_builder_set_attached(parser->builder, TRUE);
+      return read_literal(parser, "true");
+    } else {
+      return skip_value(parser, depth);
+    }
+  } else if (strcmp(name, "services") == 0 && peek(parser, '[')) {
+    ua_status_builder_clear_services(parser->builder);
+    return read_array(parser, depth, service_element);
+  } else {
+    return skip_value(parser, depth);
+  }
+}
+
+// Parse the Pro status JSON in [data]. Only the attached state and the
+// available services are extracted, the rest of the document is validated
+// for structure but otherwise ignored.
+UaStatus *ua_status_parse(const gchar *data, gsize data_length,
+                          GError **error) {
+  StatusParser parser = {
+      .data = data,
+      .end = data + data_length,
+      .p = data,
+      .error = error,
+      .member_name = g_string_new(NULL),
+      .name = g_string_new(NULL),
+      .description = g_string_new(NULL),
+      .entitled = g_string_new(NULL),
+      .status = g_string_new(NULL),
+      .available = g_string_new(NULL),
+      .builder = ua_status_builder_new(),
+  };
+
+  UaStatus *status = NULL;
+  if (!peek(&parser, '{')) {
+    parse_error(&parser, "expected object");
+  } else if (read_object(&parser, 0, status_member)) {
+    skip_whitespace(&parser);
+    if (parser.p != parser.end) {
+      parse_error(&parser, "unexpected data after object");
+    } else {
+      status = ua_status_builder_end(parser.builder);
+    }
+  }
+
+  g_string_free(parser.member_name, TRUE);
+  g_string_free(parser.name, TRUE);
+  g_string_free(parser.description, TRUE);
+  g_string_free(parser.entitled, TRUE);
+  g_string_free(parser.status, TRUE);
+  g_string_free(parser.available, TRUE);
+  ua_status_builder_free(parser.builder);
+
+  return status;
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <glib-object.h>
+
+#include "ua-status.h"
+
+UaStatus *ua_status_parse(const gchar *data, gsize data_length, GError **error);
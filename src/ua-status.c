@@ -1,59 +1,275 @@
+#include <string.h>
+
+#include "ua-service-private.h"
 #include "ua-status.h"
 
+// A snapshot is a single allocation: this header, followed by the service
+// records, followed by a hash table indexing them by name, followed by the
+// strings they reference.
 struct _UaStatus {
-  GObject parent_instance;
+  gint ref_count;
+
+  gboolean attached;
+
+  // Open addressing hash table with [n_buckets] entries, a power of two. Each
+  // entry is the index of a service plus one, or zero if empty.
+  guint32 *buckets;
+  guint n_buckets;
 
+  guint n_services;
+  UaService services[];
+};
+
+// A service added to a builder, with the name, description and any unknown
+// entitled and status values stored as offsets into the builder strings.
+typedef struct {
+  gsize name_offset;
+  gsize description_offset;
+  gsize entitled_offset;
+  gsize status_offset;
+  UaService service;
+} PendingService;
+
+struct _UaStatusBuilder {
   gboolean attached;
-  GPtrArray *services;
+  GArray *services;
+  GString *strings;
 };
 
-G_DEFINE_TYPE(UaStatus, ua_status, G_TYPE_OBJECT)
+// Create a builder for a status snapshot.
+UaStatusBuilder *ua_status_builder_new() {
+  UaStatusBuilder *self = g_new0(UaStatusBuilder, 1);
+
+  self->services = g_array_new(FALSE, FALSE, sizeof(PendingService));
+  self->strings = g_string_new(NULL);
 
-static void ua_status_dispose(GObject *object) {
-  UaStatus *self = UA_STATUS(object);
+  return self;
+}
 
-  g_clear_pointer(&self->services, g_ptr_array_unref);
+// Set if this machine is attached to an Ubuntu Advantage subscription.
+void ua_status_builder_set_attached(UaStatusBuilder *self, gboolean attached) {
+  g_return_if_fail(self != NULL);
+  self->attached = attached;
+}
 
-  G_OBJECT_CLASS(ua_status_parent_class)->dispose(object);
+// Append [value] and its nul terminator to the builder strings, returning its
+// offset.
+static gsize add_string(UaStatusBuilder *self, const gchar *value) {
+  gsize offset = self->strings->len;
+  g_string_append_len(self->strings, value != NULL ? value : "",
+                      value != NULL ? strlen(value) + 1 : 1);
+  return offset;
 }
 
-static void ua_status_init(UaStatus *self) {}
+// Add an available Ubuntu Advantage service.
+void ua_status_builder_add_service(UaStatusBuilder *self, const gchar *name,
+                                   const gchar *description,
+                                   const gchar *entitled, const gchar *status) {
+  g_return_if_fail(self != NULL);
 
-static void ua_status_class_init(UaStatusClass *klass) {
-  G_OBJECT_CLASS(klass)->dispose = ua_status_dispose;
+  PendingService pending = {0};
+  pending.name_offset = add_string(self, name);
+  pending.description_offset = add_string(self, description);
+  ua_service_set_values(&pending.service, entitled, status);
+  if (pending.service.entitled == NULL) {
+    pending.entitled_offset = add_string(self, entitled);
+  }
+  if (pending.service.status == NULL) {
+    pending.status_offset = add_string(self, status);
+  }
+  g_array_append_val(self->services, pending);
 }
 
-UaStatus *ua_status_new(gboolean attached, GPtrArray *services) {
-  UaStatus *self = g_object_new(ua_status_get_type(), NULL);
+// Remove all services added so far.
+void ua_status_builder_clear_services(UaStatusBuilder *self) {
+  g_return_if_fail(self != NULL);
 
-  self->attached = attached;
-  self->services = g_ptr_array_ref(services);
+  g_array_set_size(self->services, 0);
+  g_string_truncate(self->strings, 0);
+}
+
+// Returns the first bucket to check for a service with [name].
+static guint get_bucket(UaStatus *self, const gchar *name) {
+  return g_str_hash(name) & (self->n_buckets - 1);
+}
+
+// Returns the index of the service with [name], or -1 if not present.
+static gint lookup_service(UaStatus *self, const gchar *name) {
+  for (guint bucket = get_bucket(self, name);;
+       bucket = (bucket + 1) & (self->n_buckets - 1)) {
+    guint32 entry = self->buckets[bucket];
+    if (entry == 0) {
+      return -1;
+    }
+    if (strcmp(self->services[entry - 1].name, name) == 0) {
+      return entry - 1;
+    }
+  }
+}
+
+// Add the service at [index] to the hash table. Services with the same name
+// as an existing service are not indexed, so lookups find the first one.
+static void index_service(UaStatus *self, guint index) {
+  const gchar *name = self->services[index].name;
+  if (lookup_service(self, name) >= 0) {
+    return;
+  }
+
+  guint bucket = get_bucket(self, name);
+  while (self->buckets[bucket] != 0) {
+    bucket = (bucket + 1) & (self->n_buckets - 1);
+  }
+  self->buckets[bucket] = index + 1;
+}
+
+// Create a snapshot from the values added to the builder. The builder is
+// cleared so it can be reused.
+UaStatus *ua_status_builder_end(UaStatusBuilder *self) {
+  g_return_val_if_fail(self != NULL, NULL);
+
+  // Keep the hash table at most half full so probe sequences stay short.
+  guint n_services = self->services->len;
+  guint n_buckets = 1;
+  while (n_buckets < n_services * 2) {
+    n_buckets <<= 1;
+  }
+
+  gsize records_size = sizeof(UaStatus) + n_services * sizeof(UaService);
+  gsize buckets_size = n_buckets * sizeof(guint32);
+  UaStatus *status = g_malloc(records_size + buckets_size + self->strings->len);
+  gchar *strings = (gchar *)status + records_size + buckets_size;
+  memcpy(strings, self->strings->str, self->strings->len);
 
+  status->ref_count = 1;
+  status->attached = self->attached;
+  status->buckets = (guint32 *)((gchar *)status + records_size);
+  status->n_buckets = n_buckets;
+  memset(status->buckets, 0, buckets_size);
+  status->n_services = n_services;
+  for (guint i = 0; i < n_services; i++) {
+    PendingService *pending = &g_array_index(self->services, PendingService, i);
+    UaService *service = &status->services[i];
+
+    *service = pending->service;
+    service->name = strings + pending->name_offset;
+    service->description = strings + pending->description_offset;
+    if (service->entitled == NULL) {
+      service->entitled = strings + pending->entitled_offset;
+    }
+    if (service->status == NULL) {
+      service->status = strings + pending->status_offset;
+    }
+    index_service(status, i);
+  }
+
+  self->attached = FALSE;
+  ua_status_builder_clear_services(self);
+
+  return status;
+}
+
+void ua_status_builder_free(UaStatusBuilder *self) {
+  g_array_unref(self->services);
+  g_string_free(self->strings, TRUE);
+  g_free(self);
+}
+
+UaStatus *ua_status_ref(UaStatus *self) {
+  g_return_val_if_fail(self != NULL, NULL);
+  g_atomic_int_inc(&self->ref_count);
   return self;
 }
 
+void ua_status_unref(UaStatus *self) {
+  g_return_if_fail(self != NULL);
+  if (g_atomic_int_dec_and_test(&self->ref_count)) {
+    g_free(self);
+  }
+}
+
 // Returns TRUE if this machine is attached to an Ubuntu Advantage subscription.
 gboolean ua_status_get_attached(UaStatus *self) {
-  g_return_val_if_fail(UA_IS_STATUS(self), FALSE);
+  g_return_val_if_fail(self != NULL, FALSE);
   return self->attached;
 }
 
-// Gets the Ubuntu Advantage services that are available.
-GPtrArray *ua_status_get_services(UaStatus *self) {
-  g_return_val_if_fail(UA_IS_STATUS(self), NULL);
-  return self->services;
+// Gets the number of Ubuntu Advantage services that are available.
+guint ua_status_get_n_services(UaStatus *self) {
+  g_return_val_if_fail(self != NULL, 0);
+  return self->n_services;
+}
+
+// Gets the available Ubuntu Advantage service at [index].
+UaService *ua_status_get_service_by_index(UaStatus *self, guint index) {
+  g_return_val_if_fail(self != NULL, NULL);
+  g_return_val_if_fail(index < self->n_services, NULL);
+  return &self->services[index];
 }
 
 // Gets the Ubuntu Advantage services with [name].
 UaService *ua_status_get_service(UaStatus *self, const gchar *name) {
-  g_return_val_if_fail(UA_IS_STATUS(self), NULL);
+  g_return_val_if_fail(self != NULL, NULL);
 
-  for (guint i = 0; i < self->services->len; i++) {
-    UaService *service = g_ptr_array_index(self->services, i);
-    if (g_strcmp0(ua_service_get_name(service), name) == 0) {
-      return service;
+  if (name == NULL) {
+    return NULL;
+  }
+
+  gint index = lookup_service(self, name);
+  return index >= 0 ? &self->services[index] : NULL;
+}
+
+// Returns TRUE if [self] and [status] have the same values.
+gboolean ua_status_equal(UaStatus *self, UaStatus *status) {
+  g_return_val_if_fail(self != NULL, FALSE);
+  g_return_val_if_fail(status != NULL, FALSE);
+
+  if (self->attached != status->attached ||
+      self->n_services != status->n_services) {
+    return FALSE;
+  }
+
+  for (guint i = 0; i < self->n_services; i++) {
+    if (!ua_service_equal(&self->services[i], &status->services[i])) {
+      return FALSE;
     }
   }
 
-  return NULL;
+  return TRUE;
+}
+
+// Add the services from [status] to [builder], with the status of those in
+// [names] replaced by [service_status].
+static void add_services(UaStatusBuilder *builder, UaStatus *status,
+                         const gchar *const *names,
+                         const gchar *service_status) {
+  for (guint i = 0; i < status->n_services; i++) {
+    UaService *service = &status->services[i];
+    gboolean replace = names != NULL && g_strv_contains(names, service->name);
+    ua_status_builder_add_service(builder, service->name, service->description,
+                                  service->entitled,
+                                  replace ? service_status : service->status);
+  }
+}
+
+// Create a copy of [self] with the attached state set to [attached].
+UaStatus *ua_status_copy_with_attached(UaStatus *self, gboolean attached) {
+  g_return_val_if_fail(self != NULL, NULL);
+
+  g_autoptr(UaStatusBuilder) builder = ua_status_builder_new();
+  ua_status_builder_set_attached(builder, attached);
+  add_services(builder, self, NULL, NULL);
+  return ua_status_builder_end(builder);
+}
+
+// Create a copy of [self] with the status of the services in [names] set to
+// [service_status]. Names of services not in [self] are ignored.
+UaStatus *ua_status_copy_with_service_status(UaStatus *self,
+                                             const gchar *const *names,
+                                             const gchar *service_status) {
+  g_return_val_if_fail(self != NULL, NULL);
+
+  g_autoptr(UaStatusBuilder) builder = ua_status_builder_new();
+  ua_status_builder_set_attached(builder, self->attached);
+  add_services(builder, self, names, service_status);
+  return ua_status_builder_end(builder);
 }
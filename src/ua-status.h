@@ -1,15 +1,51 @@
 #pragma once
 
-#include <glib-object.h>
+#include <glib.h>
 
 #include "ua-service.h"
 
-G_DECLARE_FINAL_TYPE(UaStatus, ua_status, UA, STATUS, GObject)
+// An immutable snapshot of the Pro status. Snapshots are reference counted
+// and may be shared between threads.
+typedef struct _UaStatus UaStatus;
 
-UaStatus *ua_status_new(gboolean attached, GPtrArray *services);
+// Accumulates services to create a UaStatus snapshot.
+typedef struct _UaStatusBuilder UaStatusBuilder;
+
+UaStatusBuilder *ua_status_builder_new();
+
+void ua_status_builder_set_attached(UaStatusBuilder *builder,
+                                    gboolean attached);
+
+void ua_status_builder_add_service(UaStatusBuilder *builder, const gchar *name,
+                                   const gchar *description,
+                                   const gchar *entitled, const gchar *status);
+
+void ua_status_builder_clear_services(UaStatusBuilder *builder);
+
+UaStatus *ua_status_builder_end(UaStatusBuilder *builder);
+
+void ua_status_builder_free(UaStatusBuilder *builder);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(UaStatusBuilder, ua_status_builder_free)
+
+UaStatus *ua_status_ref(UaStatus *status);
+
+void ua_status_unref(UaStatus *status);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(UaStatus, ua_status_unref)
 
 gboolean ua_status_get_attached(UaStatus *status);
 
-GPtrArray *ua_status_get_services(UaStatus *status);
+guint ua_status_get_n_services(UaStatus *status);
+
+UaService *ua_status_get_service_by_index(UaStatus *status, guint index);
 
 UaService *ua_status_get_service(UaStatus *status, const gchar *name);
+
+gboolean ua_status_equal(UaStatus *status, UaStatus *other);
+
+UaStatus *ua_status_copy_with_attached(UaStatus *status, gboolean attached);
+
+UaStatus *ua_status_copy_with_service_status(UaStatus *status,
+                                             const gchar *const *names,
+                                             const gchar *service_status);
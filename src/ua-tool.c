@@ -1,11 +1,22 @@
 #include <gio/gio.h>
+#include <json-glib/json-glib.h>
+#include <signal.h>
 
 #include "ua-tool.h"
 
+// Number of lines of stderr kept to report when pro fails.
+#define MAX_STDERR_LINES 10
+
+// Longest line of output reported, in bytes. The rest of a longer line is
+// dropped, so output without line breaks doesn't use unbounded memory.
+#define MAX_LINE_LENGTH 4096
+
 typedef struct {
   char *config_contents;
   GFile *config_file;
   GFileIOStream *iostream;
+  UaProgressFunction progress_callback;
+  gpointer progress_data;
 } AttachData;
 
 static void attach_data_free(AttachData *data) {
@@ -15,82 +26,469 @@ static void attach_data_free(AttachData *data) {
   g_free(data);
 }
 
-// Wait for [subprocess] to complete, and return an error in [task] if it did
-// not.
-static gboolean wait_finish(GSubprocess *subprocess, GAsyncResult *result,
-                            GTask *task) {
+// Reads the output pro writes to stdout or stderr.
+typedef struct {
+  GInputStream *stream;
+  gboolean is_stderr;
+
+  // The line being read, up to MAX_LINE_LENGTH bytes.
+  GString *line;
+
+  // TRUE if bytes have been dropped from the end of [line].
+  gboolean truncated;
+
+  gchar buffer[MAX_LINE_LENGTH];
+} OutputReader;
+
+static void output_reader_init(OutputReader *reader, GInputStream *stream,
+                               gboolean is_stderr) {
+  reader->stream = g_object_ref(stream);
+  reader->is_stderr = is_stderr;
+  reader->line = g_string_new(NULL);
+}
+
+static void output_reader_clear(OutputReader *reader) {
+  g_clear_object(&reader->stream);
+  if (reader->line != NULL) {
+    g_string_free(reader->line, TRUE);
+    reader->line = NULL;
+  }
+}
+
+// A running pro process. Its output is read as it is produced, so the
+// process never blocks writing to a full pipe.
+typedef struct {
+  GSubprocess *subprocess;
+  GCancellable *cancellable;
+  gulong cancelled_id;
+  OutputReader stdout_reader;
+  OutputReader stderr_reader;
+  UaProgressFunction progress_callback;
+  gpointer progress_data;
+
+  // Complete stdout, if it is being collected rather than reported as
+  // progress.
+  GString *stdout_data;
+
+  // The last lines written to stderr, oldest first.
+  GQueue *stderr_tail;
+
+  // Number of output streams and process exit still to complete.
+  guint n_pending;
+  GError *error;
+} ProcessData;
+
+static void process_data_free(ProcessData *data) {
+  if (data->cancellable != NULL) {
+    g_cancellable_disconnect(data->cancellable, data->cancelled_id);
+  }
+  g_clear_object(&data->cancellable);
+  g_clear_object(&data->subprocess);
+  output_reader_clear(&data->stdout_reader);
+  output_reader_clear(&data->stderr_reader);
+  if (data->stdout_data != NULL) {
+    g_string_free(data->stdout_data, TRUE);
+  }
+  g_queue_free_full(data->stderr_tail, g_free);
+  g_clear_error(&data->error);
+  g_free(data);
+}
+
+// Make an error for a process that did not exit successfully, including the
+// last lines it wrote to stderr.
+static GError *make_exit_error(ProcessData *data) {
+  g_autoptr(GString) message = g_string_new(NULL);
+  if (g_subprocess_get_if_exited(data->subprocess)) {
+    g_string_append_printf(message, "Pro client exited with code %d",
+                           g_subprocess_get_exit_status(data->subprocess));
+  } else {
+    g_string_append_printf(message, "Pro client exited with signal %d",
+                           g_subprocess_get_term_sig(data->subprocess));
+  }
+  for (GList *link = data->stderr_tail->head; link != NULL;
+       link = link->next) {
+    g_string_append(message, link == data->stderr_tail->head ? ": " : "\n");
+    g_string_append(message, link->data);
+  }
+
+  return g_error_new_literal(G_IO_ERROR, G_IO_ERROR_FAILED, message->str);
+}
+
+// Called when an output stream or the process completes. When all have, the
+// result of the process is returned in [task].
+static void process_step_complete(GTask *task) {
+  ProcessData *data = g_task_get_task_data(task);
+
+  data->n_pending--;
+  if (data->n_pending > 0) {
+    return;
+  }
+
+  if (data->error == NULL) {
+    g_cancellable_set_error_if_cancelled(data->cancellable, &data->error);
+  }
+  if (data->error == NULL && !g_subprocess_get_successful(data->subprocess)) {
+    data->error = make_exit_error(data);
+  }
+  if (data->error != NULL) {
+    g_task_return_error(task, g_steal_pointer(&data->error));
+  } else {
+    g_task_return_boolean(task, TRUE);
+  }
+}
+
+// Handle a [line] of output from the process.
+static void add_output_line(ProcessData *data, gboolean is_stderr,
+                            const gchar *line) {
+  // Progress is sent over D-Bus, which requires valid UTF-8.
+  if (!g_utf8_validate(line, -1, NULL)) {
+    return;
+  }
+
+  if (is_stderr) {
+    g_queue_push_tail(data->stderr_tail, g_strdup(line));
+    if (g_queue_get_length(data->stderr_tail) > MAX_STDERR_LINES) {
+      g_free(g_queue_pop_head(data->stderr_tail));
+    }
+  }
+
+  if (data->progress_callback != NULL) {
+    data->progress_callback(line, data->progress_data);
+  }
+}
+
+// Handle the line read so far by [reader], if any, and start a new line.
+static void end_line(ProcessData *data, OutputReader *reader) {
+  GString *line = reader->line;
+
+  // Don't leave part of a character where a long line was cut off.
+  if (reader->truncated && line->len > 0) {
+    const gchar *end = line->str + line->len;
+    const gchar *last = g_utf8_find_prev_char(line->str, end);
+    if (last != NULL &&
+        g_utf8_get_char_validated(last, end - last) == (gunichar)-2) {
+      g_string_truncate(line, last - line->str);
+    }
+  }
+
+  if (line->len > 0) {
+    add_output_line(data, reader->is_stderr, line->str);
+  }
+  g_string_truncate(line, 0);
+  reader->truncated = FALSE;
+}
+
+// Handle [length] bytes of output read into the buffer of [reader]. A
+// carriage return ends a line as well as a newline, as progress meters such
+// as apt's use it to redraw the line in place.
+static void add_output(ProcessData *data, OutputReader *reader,
+                       gsize length) {
+  if (!reader->is_stderr && data->stdout_data != NULL) {
+    g_string_append_len(data->stdout_data, reader->buffer, length);
+    return;
+  }
+
+  for (gsize i = 0; i < length; i++) {
+    gchar c = reader->buffer[i];
+    if (c == '\n' || c == '\r') {
+      end_line(data, reader);
+    } else if (reader->line->len < MAX_LINE_LENGTH) {
+      g_string_append_c(reader->line, c);
+    } else {
+      reader->truncated = TRUE;
+    }
+  }
+}
+
+static void read_output_cb(GObject *object, GAsyncResult *result,
+                           gpointer user_data);
+
+// Read the next output from [reader] for the process in [task].
+static void read_output(OutputReader *reader, GTask *task) {
+  g_input_stream_read_async(reader->stream, reader->buffer,
+                            sizeof(reader->buffer), G_PRIORITY_DEFAULT, NULL,
+                            read_output_cb, task);
+}
+
+// Called when output has been read from stdout or stderr.
+static void read_output_cb(GObject *object, GAsyncResult *result,
+                           gpointer user_data) {
+  GInputStream *stream = G_INPUT_STREAM(object);
+  g_autoptr(GTask) task = G_TASK(user_data);
+  ProcessData *data = g_task_get_task_data(task);
+  OutputReader *reader = stream == data->stderr_reader.stream
+                             ? &data->stderr_reader
+                             : &data->stdout_reader;
+
+  g_autoptr(GError) error = NULL;
+  gssize n_read = g_input_stream_read_finish(stream, result, &error);
+  if (n_read <= 0) {
+    if (n_read < 0 && data->error == NULL) {
+      data->error = g_steal_pointer(&error);
+    }
+    // Handle a last line that has no line break.
+    end_line(data, reader);
+    process_step_complete(task);
+    return;
+  }
+
+  add_output(data, reader, n_read);
+  read_output(reader, g_steal_pointer(&task));
+}
+
+// Called when the pro process exits.
+static void process_wait_cb(GObject *object, GAsyncResult *result,
+                            gpointer user_data) {
+  g_autoptr(GTask) task = G_TASK(user_data);
+  ProcessData *data = g_task_get_task_data(task);
+
   g_autoptr(GError) error = NULL;
-  if (!g_subprocess_wait_finish(subprocess, result, &error)) {
+  if (!g_subprocess_wait_finish(G_SUBPROCESS(object), result, &error) &&
+      data->error == NULL) {
+    data->error = g_steal_pointer(&error);
+  }
+  process_step_complete(task);
+}
+
+// Called when a running pro process is cancelled.
+static void process_cancelled_cb(GCancellable *cancellable,
+                                 gpointer user_data) {
+  GSubprocess *subprocess = user_data;
+  // Let pro release its lock and clean up.
+  g_subprocess_send_signal(subprocess, SIGTERM);
+}
+
+// Run pro with [argv], passing each line it outputs to [progress_callback].
+// If [collect_stdout] is set, stdout is instead returned by run_pro_finish().
+// If [cancellable] is triggered pro is terminated, and the request completes
+// with G_IO_ERROR_CANCELLED once it has exited.
+static void run_pro(const gchar *const *argv, gboolean collect_stdout,
+                    GCancellable *cancellable,
+                    UaProgressFunction progress_callback,
+                    gpointer progress_data, GAsyncReadyCallback callback,
+                    gpointer callback_data) {
+  g_autoptr(GTask) task =
+      g_task_new(NULL, cancellable, callback, callback_data);
+
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GSubprocess) subprocess = g_subprocess_newv(
+      argv, G_SUBPROCESS_FLAGS_STDOUT_PIPE | G_SUBPROCESS_FLAGS_STDERR_PIPE,
+      &error);
+  if (subprocess == NULL) {
     g_task_return_error(task, g_steal_pointer(&error));
-    return FALSE;
+    return;
   }
 
-  if (g_subprocess_get_successful(subprocess)) {
-    return TRUE;
+  ProcessData *data = g_new0(ProcessData, 1);
+  data->subprocess = g_object_ref(subprocess);
+  output_reader_init(&data->stdout_reader,
+                     g_subprocess_get_stdout_pipe(subprocess), FALSE);
+  output_reader_init(&data->stderr_reader,
+                     g_subprocess_get_stderr_pipe(subprocess), TRUE);
+  data->progress_callback = progress_callback;
+  data->progress_data = progress_data;
+  if (collect_stdout) {
+    data->stdout_data = g_string_new(NULL);
   }
+  data->stderr_tail = g_queue_new();
+  data->n_pending = 3;
+  g_task_set_task_data(task, data, (GDestroyNotify)process_data_free);
+
+  // The output and exit are always waited for, so the request doesn't
+  // complete while pro is still running and holding its lock.
+  read_output(&data->stdout_reader, g_object_ref(task));
+  read_output(&data->stderr_reader, g_object_ref(task));
+  g_subprocess_wait_async(subprocess, NULL, process_wait_cb,
+                          g_object_ref(task));
+  if (cancellable != NULL) {
+    data->cancellable = g_object_ref(cancellable);
+    data->cancelled_id = g_cancellable_connect(
+        cancellable, G_CALLBACK(process_cancelled_cb), data->subprocess, NULL);
+  }
+}
 
-  if (g_subprocess_get_if_exited(subprocess)) {
-    g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_FAILED,
-                            "Pro client exited with code %d",
-                            g_subprocess_get_exit_status(subprocess));
-  } else {
-    g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_FAILED,
-                            "Pro client exited with signal %d",
-                            g_subprocess_get_term_sig(subprocess));
+// Complete a process started with run_pro(). Returns FALSE if pro could not
+// be run or did not exit successfully. If stdout was collected it is returned
+// in [stdout_data], even if pro failed.
+static gboolean run_pro_finish(GAsyncResult *result, gchar **stdout_data,
+                               GError **error) {
+  ProcessData *data = g_task_get_task_data(G_TASK(result));
+  if (stdout_data != NULL && data != NULL && data->stdout_data != NULL) {
+    *stdout_data = g_strdup(data->stdout_data->str);
   }
 
-  return FALSE;
+  return g_task_propagate_boolean(G_TASK(result), error);
 }
 
 // Called when 'pro attach' process completes.
 static void ua_attach_cb(GObject *object, GAsyncResult *result,
                          gpointer user_data) {
-  GSubprocess *subprocess = G_SUBPROCESS(object);
   g_autoptr(GTask) task = G_TASK(user_data);
   AttachData *attach_data = g_task_get_task_data(task);
   g_autoptr(GFile) config_file = g_steal_pointer(&attach_data->config_file);
 
-  if (wait_finish(subprocess, result, task)) {
+  g_autoptr(GError) error = NULL;
+  if (run_pro_finish(result, NULL, &error)) {
     g_task_return_boolean(task, TRUE);
+  } else {
+    g_task_return_error(task, g_steal_pointer(&error));
   }
 
   // We don't really care about of the result of this operation.
   g_file_delete_async(config_file, G_PRIORITY_DEFAULT, NULL, NULL, NULL);
 }
 
-// Called when 'pro detach' process completes.
-static void ua_detach_cb(GObject *object, GAsyncResult *result,
-                         gpointer user_data) {
-  GSubprocess *subprocess = G_SUBPROCESS(object);
-  g_autoptr(GTask) task = G_TASK(user_data);
+// Get the array [member_name] from [object], or NULL if not present.
+static JsonArray *get_array_member(JsonObject *object,
+                                   const gchar *member_name) {
+  JsonNode *node = json_object_get_member(object, member_name);
+  if (node == NULL || !JSON_NODE_HOLDS_ARRAY(node)) {
+    return NULL;
+  }
+  return json_node_get_array(node);
+}
 
-  if (wait_finish(subprocess, result, task)) {
-    g_task_return_boolean(task, TRUE);
+// Get the string [member_name] from [object], or NULL if not present.
+static const gchar *get_string_member(JsonObject *object,
+                                      const gchar *member_name) {
+  JsonNode *node = json_object_get_member(object, member_name);
+  if (node == NULL || json_node_get_value_type(node) != G_TYPE_STRING) {
+    return NULL;
   }
+  return json_node_get_string(node);
 }
 
-// Called when 'pro enable' process completes.
-static void ua_enable_cb(GObject *object, GAsyncResult *result,
-                         gpointer user_data) {
-  GSubprocess *subprocess = G_SUBPROCESS(object);
-  g_autoptr(GTask) task = G_TASK(user_data);
+// Returns TRUE if [array] contains the string [value].
+static gboolean array_contains_string(JsonArray *array, const gchar *value) {
+  for (guint i = 0; array != NULL && i < json_array_get_length(array); i++) {
+    JsonNode *node = json_array_get_element(array, i);
+    if (json_node_get_value_type(node) == G_TYPE_STRING &&
+        g_strcmp0(json_node_get_string(node), value) == 0) {
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
 
-  if (wait_finish(subprocess, result, task)) {
-    g_task_return_boolean(task, TRUE);
+// Get the results for [service_names] from the JSON output of
+// 'pro enable --format json' or 'pro disable --format json'.
+static GPtrArray *parse_service_results(const gchar *output,
+                                        const gchar *const *service_names,
+                                        GError **error) {
+  g_autoptr(JsonParser) parser = json_parser_new();
+  if (!json_parser_load_from_data(parser, output, -1, error)) {
+    return NULL;
+  }
+  JsonNode *root = json_parser_get_root(parser);
+  if (root == NULL || !JSON_NODE_HOLDS_OBJECT(root)) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                "Pro client output is not a JSON object");
+    return NULL;
+  }
+  JsonObject *object = json_node_get_object(root);
+  JsonArray *processed_services =
+      get_array_member(object, "processed_services");
+
+  // Errors are either for a single service, or for the whole command.
+  g_autoptr(GHashTable) service_errors =
+      g_hash_table_new(g_str_hash, g_str_equal);
+  const gchar *general_error = NULL;
+  JsonArray *errors = get_array_member(object, "errors");
+  for (guint i = 0; errors != NULL && i < json_array_get_length(errors); i++) {
+    JsonNode *node = json_array_get_element(errors, i);
+    if (!JSON_NODE_HOLDS_OBJECT(node)) {
+      continue;
+    }
+    JsonObject *e = json_node_get_object(node);
+    const gchar *service = get_string_member(e, "service");
+    const gchar *message = get_string_member(e, "message");
+    if (message == NULL) {
+      continue;
+    }
+    if (service != NULL) {
+      g_hash_table_insert(service_errors, (gpointer)service, (gpointer)message);
+    } else if (general_error == NULL) {
+      general_error = message;
+    }
+  }
+
+  GPtrArray *results =
+      g_ptr_array_new_with_free_func((GDestroyNotify)ua_service_result_free);
+  for (const gchar *const *name = service_names; *name != NULL; name++) {
+    UaServiceResult *result = g_new0(UaServiceResult, 1);
+    result->name = g_strdup(*name);
+    result->success = array_contains_string(processed_services, *name);
+    const gchar *message = g_hash_table_lookup(service_errors, *name);
+    if (message == NULL && !result->success) {
+      message = general_error != NULL ? general_error : "Not processed";
+    }
+    result->message = g_strdup(message != NULL ? message : "");
+    g_ptr_array_add(results, result);
   }
+
+  return results;
 }
 
-// Called when 'pro disable' process completes.
-static void ua_disable_cb(GObject *object, GAsyncResult *result,
-                          gpointer user_data) {
-  GSubprocess *subprocess = G_SUBPROCESS(object);
+// Called when a 'pro enable' or 'pro disable' process for multiple services
+// completes.
+static void ua_services_cb(GObject *object, GAsyncResult *result,
+                           gpointer user_data) {
   g_autoptr(GTask) task = G_TASK(user_data);
+  const gchar *const *service_names = g_task_get_task_data(task);
+
+  g_autofree gchar *output = NULL;
+  g_autoptr(GError) process_error = NULL;
+  gboolean success = run_pro_finish(result, &output, &process_error);
+  if (output == NULL ||
+      g_error_matches(process_error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+    g_task_return_error(task, g_steal_pointer(&process_error));
+    return;
+  }
 
-  if (wait_finish(subprocess, result, task)) {
-    g_task_return_boolean(task, TRUE);
+  // pro exits with an error if any service fails, so use the results it
+  // reports if they can be read.
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GPtrArray) results =
+      parse_service_results(output, service_names, &error);
+  if (results != NULL) {
+    g_task_return_pointer(task, g_steal_pointer(&results),
+                          (GDestroyNotify)g_ptr_array_unref);
+  } else if (!success) {
+    g_task_return_error(task, g_steal_pointer(&process_error));
+  } else {
+    g_task_return_error(task, g_steal_pointer(&error));
   }
 }
 
+// Run 'pro [command]' on [service_names] in one process.
+static void run_services_command(const char *command,
+                                 const char *const *service_names,
+                                 GCancellable *cancellable,
+                                 UaProgressFunction progress_callback,
+                                 gpointer progress_data,
+                                 GAsyncReadyCallback callback,
+                                 gpointer callback_data) {
+  g_autoptr(GTask) task =
+      g_task_new(NULL, cancellable, callback, callback_data);
+  g_task_set_task_data(task, g_strdupv((gchar **)service_names),
+                       (GDestroyNotify)g_strfreev);
+
+  g_autoptr(GPtrArray) argv = g_ptr_array_new();
+  g_ptr_array_add(argv, "pro");
+  g_ptr_array_add(argv, (gpointer)command);
+  g_ptr_array_add(argv, "--assume-yes");
+  g_ptr_array_add(argv, "--format");
+  g_ptr_array_add(argv, "json");
+  for (const char *const *name = service_names; *name != NULL; name++) {
+    g_ptr_array_add(argv, (gpointer)*name);
+  }
+  g_ptr_array_add(argv, NULL);
+
+  run_pro((const gchar *const *)argv->pdata, TRUE, cancellable,
+          progress_callback, progress_data, ua_services_cb,
+          g_steal_pointer(&task));
+}
+
 // Called when token configuration file if filled.
 static void ua_attach_call_client(GObject *object, GAsyncResult *result,
                                   gpointer user_data) {
@@ -99,6 +497,9 @@ static void ua_attach_call_client(GObject *object, GAsyncResult *result,
   g_autoptr(GError) error = NULL;
 
   if (!g_output_stream_write_all_finish(output_stream, result, NULL, &error)) {
+    AttachData *attach_data = g_task_get_task_data(task);
+    g_file_delete_async(attach_data->config_file, G_PRIORITY_DEFAULT, NULL,
+                        NULL, NULL);
     g_task_return_error(task, g_steal_pointer(&error));
     return;
   }
@@ -109,31 +510,19 @@ static void ua_attach_call_client(GObject *object, GAsyncResult *result,
 
   AttachData *attach_data = g_task_get_task_data(task);
   g_autofree char *config_file_path = g_file_get_path(attach_data->config_file);
-  g_autoptr(GSubprocess) subprocess =
-      g_subprocess_new(G_SUBPROCESS_FLAGS_STDOUT_PIPE, &error, "pro", "attach",
-                       "--attach-config", config_file_path, NULL);
-  if (subprocess == NULL) {
-    g_task_return_error(task, g_steal_pointer(&error));
-    return;
-  }
-
-  GCancellable *cancellable = g_task_get_cancellable(task);
-  g_subprocess_wait_async(subprocess, cancellable, ua_attach_cb,
-                          g_steal_pointer(&task));
+  const gchar *argv[] = {"pro", "attach", "--attach-config", config_file_path,
+                         NULL};
+  run_pro(argv, FALSE, g_task_get_cancellable(task),
+          attach_data->progress_callback, attach_data->progress_data,
+          ua_attach_cb, g_steal_pointer(&task));
 }
 
 static void write_attach_config_file(GFile *config_file,
                                      GFileIOStream *iostream, GTask *task) {
-  const char *token = g_task_get_task_data(task);
-  AttachData *attach_data = g_new0(AttachData, 1);
-  // See:
-  // https://canonical-ubuntu-pro-client.readthedocs-hosted.com/en/latest/howtoguides/how_to_attach_with_config_file/
-  attach_data->config_contents = g_strdup_printf("token: %s\n", token);
+  AttachData *attach_data = g_task_get_task_data(task);
   attach_data->config_file = g_object_ref(config_file);
   attach_data->iostream = g_object_ref(iostream);
 
-  g_task_set_task_data(task, attach_data, (GDestroyNotify)attach_data_free);
-
   GCancellable *cancellable = g_task_get_cancellable(task);
   GOutputStream *output_stream =
       g_io_stream_get_output_stream(G_IO_STREAM(iostream));
@@ -166,12 +555,19 @@ static void ua_token_file_create_cb(GObject *object, GAsyncResult *result,
 
 // Attach this machine to an Ubuntu Advantage subscription.
 void ua_attach(const char *token, GCancellable *cancellable,
+               UaProgressFunction progress_callback, gpointer progress_data,
                GAsyncReadyCallback callback, gpointer callback_data) {
   static const char *file_template = "ubuntu-pro-config-XXXXXX.yaml";
   g_autoptr(GTask) task =
       g_task_new(NULL, cancellable, callback, callback_data);
 
-  g_task_set_task_data(task, g_strdup(token), g_free);
+  AttachData *attach_data = g_new0(AttachData, 1);
+  // See:
+  // https://canonical-ubuntu-pro-client.readthedocs-hosted.com/en/latest/howtoguides/how_to_attach_with_config_file/
+  attach_data->config_contents = g_strdup_printf("token: %s\n", token);
+  attach_data->progress_callback = progress_callback;
+  attach_data->progress_data = progress_data;
+  g_task_set_task_data(task, attach_data, (GDestroyNotify)attach_data_free);
 
   // This is safe because the file is going to be owned by the daemon user with
   // readwrite permissions only from the same user.
@@ -200,70 +596,83 @@ gboolean ua_attach_finish(GAsyncResult *result, GError **error) {
 }
 
 // Remove this machine from an Ubuntu Advantage subscription.
-void ua_detach(GCancellable *cancellable, GAsyncReadyCallback callback,
+void ua_detach(GCancellable *cancellable, UaProgressFunction progress_callback,
+               gpointer progress_data, GAsyncReadyCallback callback,
                gpointer callback_data) {
-  g_autoptr(GTask) task =
-      g_task_new(NULL, cancellable, callback, callback_data);
-
-  g_autoptr(GError) error = NULL;
-  g_autoptr(GSubprocess) subprocess =
-      g_subprocess_new(G_SUBPROCESS_FLAGS_STDOUT_PIPE, &error, "pro", "detach",
-                       "--assume-yes", NULL);
-  if (subprocess == NULL) {
-    g_task_return_error(task, g_steal_pointer(&error));
-    return;
-  }
-  g_subprocess_wait_async(subprocess, cancellable, ua_detach_cb,
-                          g_steal_pointer(&task));
+  const gchar *argv[] = {"pro", "detach", "--assume-yes", NULL};
+  run_pro(argv, FALSE, cancellable, progress_callback, progress_data,
+          callback, callback_data);
 }
 
 // Complete request started with ua_detach().
 gboolean ua_detach_finish(GAsyncResult *result, GError **error) {
-  return g_task_propagate_boolean(G_TASK(result), error);
+  return run_pro_finish(result, NULL, error);
 }
 
 // Enable [service_name] on this machine.
 void ua_enable(const char *service_name, GCancellable *cancellable,
+               UaProgressFunction progress_callback, gpointer progress_data,
                GAsyncReadyCallback callback, gpointer callback_data) {
-  g_autoptr(GTask) task =
-      g_task_new(NULL, cancellable, callback, callback_data);
-
-  g_autoptr(GError) error = NULL;
-  g_autoptr(GSubprocess) subprocess =
-      g_subprocess_new(G_SUBPROCESS_FLAGS_STDOUT_PIPE, &error, "pro", "enable",
-                       "--assume-yes", service_name, NULL);
-  if (subprocess == NULL) {
-    g_task_return_error(task, g_steal_pointer(&error));
-    return;
-  }
-  g_subprocess_wait_async(subprocess, cancellable, ua_enable_cb,
-                          g_steal_pointer(&task));
+  const gchar *argv[] = {"pro", "enable", "--assume-yes", service_name, NULL};
+  run_pro(argv, FALSE, cancellable, progress_callback, progress_data,
+          callback, callback_data);
 }
 
 // Complete request started with ua_enable().
 gboolean ua_enable_finish(GAsyncResult *result, GError **error) {
-  return g_task_propagate_boolean(G_TASK(result), error);
+  return run_pro_finish(result, NULL, error);
 }
 
 // Disable [service_name] on this machine.
 void ua_disable(const char *service_name, GCancellable *cancellable,
+                UaProgressFunction progress_callback, gpointer progress_data,
                 GAsyncReadyCallback callback, gpointer callback_data) {
-  g_autoptr(GTask) task =
-      g_task_new(NULL, cancellable, callback, callback_data);
-
-  g_autoptr(GError) error = NULL;
-  g_autoptr(GSubprocess) subprocess =
-      g_subprocess_new(G_SUBPROCESS_FLAGS_STDOUT_PIPE, &error, "pro", "disable",
-                       "--assume-yes", service_name, NULL);
-  if (subprocess == NULL) {
-    g_task_return_error(task, g_steal_pointer(&error));
-    return;
-  }
-  g_subprocess_wait_async(subprocess, cancellable, ua_disable_cb,
-                          g_steal_pointer(&task));
+  const gchar *argv[] = {"pro", "disable", "--assume-yes", service_name, NULL};
+  run_pro(argv, FALSE, cancellable, progress_callback, progress_data,
+          callback, callback_data);
 }
 
 // Complete request started with ua_disable().
 gboolean ua_disable_finish(GAsyncResult *result, GError **error) {
-  return g_task_propagate_boolean(G_TASK(result), error);
+  return run_pro_finish(result, NULL, error);
+}
+
+void ua_service_result_free(UaServiceResult *result) {
+  g_clear_pointer(&result->name, g_free);
+  g_clear_pointer(&result->message, g_free);
+  g_free(result);
+}
+
+// Enable [service_names] on this machine using a single pro process.
+void ua_enable_services(const char *const *service_names,
+                        GCancellable *cancellable,
+                        UaProgressFunction progress_callback,
+                        gpointer progress_data, GAsyncReadyCallback callback,
+                        gpointer callback_data) {
+  run_services_command("enable", service_names, cancellable,
+                       progress_callback, progress_data, callback,
+                       callback_data);
+}
+
+// Complete request started with ua_enable_services(). Returns an array of
+// UaServiceResult, one for each service in the order requested.
+GPtrArray *ua_enable_services_finish(GAsyncResult *result, GError **error) {
+  return g_task_propagate_pointer(G_TASK(result), error);
+}
+
+// Disable [service_names] on this machine using a single pro process.
+void ua_disable_services(const char *const *service_names,
+                         GCancellable *cancellable,
+                         UaProgressFunction progress_callback,
+                         gpointer progress_data, GAsyncReadyCallback callback,
+                         gpointer callback_data) {
+  run_services_command("disable", service_names, cancellable,
+                       progress_callback, progress_data, callback,
+                       callback_data);
+}
+
+// Complete request started with ua_disable_services(). Returns an array of
+// UaServiceResult, one for each service in the order requested.
+GPtrArray *ua_disable_services_finish(GAsyncResult *result, GError **error) {
+  return g_task_propagate_pointer(G_TASK(result), error);
 }
@@ -4,22 +4,58 @@
 
 #include "ua-status.h"
 
+// The result of enabling or disabling a single service.
+typedef struct {
+  gchar *name;
+  gboolean success;
+  // Error message from pro, or "" on success.
+  gchar *message;
+} UaServiceResult;
+
+void ua_service_result_free(UaServiceResult *result);
+
+// Called with each line of progress output from pro. Lines written to stdout
+// are not reported when the output is JSON to be parsed.
+typedef void (*UaProgressFunction)(const gchar *line, gpointer user_data);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(UaServiceResult, ua_service_result_free)
+
 void ua_attach(const char *token, GCancellable *cancellable,
+               UaProgressFunction progress_callback, gpointer progress_data,
                GAsyncReadyCallback callback, gpointer callback_data);
 
 gboolean ua_attach_finish(GAsyncResult *result, GError **error);
 
-void ua_detach(GCancellable *cancellable, GAsyncReadyCallback callback,
+void ua_detach(GCancellable *cancellable, UaProgressFunction progress_callback,
+               gpointer progress_data, GAsyncReadyCallback callback,
                gpointer callback_data);
 
 gboolean ua_detach_finish(GAsyncResult *result, GError **error);
 
 void ua_enable(const char *service_name, GCancellable *cancellable,
+               UaProgressFunction progress_callback, gpointer progress_data,
                GAsyncReadyCallback callback, gpointer callback_data);
 
 gboolean ua_enable_finish(GAsyncResult *result, GError **error);
 
 void ua_disable(const char *service_name, GCancellable *cancellable,
+                UaProgressFunction progress_callback, gpointer progress_data,
                 GAsyncReadyCallback callback, gpointer callback_data);
 
 gboolean ua_disable_finish(GAsyncResult *result, GError **error);
+
+void ua_enable_services(const char *const *service_names,
+                        GCancellable *cancellable,
+                        UaProgressFunction progress_callback,
+                        gpointer progress_data, GAsyncReadyCallback callback,
+                        gpointer callback_data);
+
+GPtrArray *ua_enable_services_finish(GAsyncResult *result, GError **error);
+
+void ua_disable_services(const char *const *service_names,
+                         GCancellable *cancellable,
+                         UaProgressFunction progress_callback,
+                         gpointer progress_data, GAsyncReadyCallback callback,
+                         gpointer callback_data);
+
+GPtrArray *ua_disable_services_finish(GAsyncResult *result, GError **error);
@@ -0,0 +1,212 @@
+#include <glib.h>
+#include <json-glib/json-glib.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ua-status-parser.h"
+
+// Number of times each parser is run.
+#define N_ITERATIONS 2000
+
+#ifdef __GLIBC__
+// Count allocations by wrapping the glibc allocator. Run with
+// G_SLICE=always-malloc so GLib allocations are counted too.
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n_members, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static guint64 n_allocations = 0;
+
+void *malloc(size_t size) {
+  n_allocations++;
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t n_members, size_t size) {
+  n_allocations++;
+  return __libc_calloc(n_members, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+  n_allocations++;
+  return __libc_realloc(ptr, size);
+}
+#else
+static guint64 n_allocations = 0;
+#endif
+
+// Generate status JSON similar to that written by 'pro status --format json'
+// on an attached machine.
+static gchar *make_status_json(guint n_services) {
+  GString *json = g_string_new(NULL);
+
+  g_string_append(
+      json, "{\"_doc\": \"Content provided in json response is currently "
+            "considered Experimental and may change\", "
+            "\"_schema_version\": \"0.1\", "
+            "\"account\": {\"created_at\": \"2022-01-01T00:00:00+00:00\", "
+            "\"external_account_ids\": [], \"id\": \"aAbBcCdDeEfF\", "
+            "\"name\": \"user@example.com\"}, "
+            "\"attached\": true, "
+            "\"config\": {\"contract_url\": \"https://contracts.canonical.com\", "
+            "\"data_dir\": \"/var/lib/ubuntu-advantage\", "
+            "\"log_file\": \"/var/log/ubuntu-advantage.log\", "
+            "\"log_level\": \"debug\", \"ua_config\": {\"apt_news\": true, "
+            "\"http_proxy\": null, \"https_proxy\": null}}, "
+            "\"config_path\": \"/etc/ubuntu-advantage/uaclient.conf\", "
+            "\"contract\": {\"created_at\": \"2022-01-01T00:00:00+00:00\", "
+            "\"id\": \"cCdDeEfFgGhH\", \"name\": \"Ubuntu Pro - free personal "
+            "subscription\", \"products\": [\"free\"], "
+            "\"tech_support_level\": \"n/a\"}, "
+            "\"effective\": null, \"environment_vars\": [], "
+            "\"errors\": [], \"execution_details\": \"No Ubuntu Pro operations "
+            "are running\", \"execution_status\": \"inactive\", "
+            "\"expires\": \"9999-12-31T00:00:00+00:00\", "
+            "\"features\": {}, \"machine_id\": \"0123456789abcdef\", "
+            "\"notices\": [");
+  for (guint i = 0; i < 20; i++) {
+    g_string_append_printf(
+        json, "%s[\"\", \"Notice %u: Operation in progress, please see "
+              "\\\"pro status\\\" for details.\"]",
+        i == 0 ? "" : ", ", i);
+  }
+  g_string_append(json, "], \"result\": \"success\", \"services\": [");
+  for (guint i = 0; i < n_services; i++) {
+    g_string_append_printf(
+        json,
+        "%s{\"available\": \"%s\", \"blocked_by\": [], "
+        "\"description\": \"Service %u: Expanded Security Maintenance for "
+        "Applications\", \"description_override\": null, "
+        "\"entitled\": \"yes\", \"name\": \"service-%u\", "
+        "\"status\": \"%s\", \"status_details\": \"Service %u is not "
+        "configured\", \"warning\": null}",
+        i == 0 ? "" : ", ", i % 4 == 3 ? "no" : "yes", i, i,
+        i % 2 == 0 ? "enabled" : "disabled", i);
+  }
+  g_string_append(json, "], \"simulated\": false, "
+                        "\"version\": \"27.14.4~22.04\", \"warnings\": []}");
+
+  return g_string_free(json, FALSE);
+}
+
+// json_object_get_string_member_with_default is only available in
+// json-glib 1.6, reimplemented here for older versions.
+static const gchar *get_string_member_with_default(JsonObject *object,
+                                                   const char *member_name,
+                                                   const char *default_value) {
+  if (json_object_has_member(object, member_name)) {
+    return json_object_get_string_member(object, member_name);
+  } else {
+    return default_value;
+  }
+}
+
+// The json-glib based parser the daemon previously used, for comparison.
+static UaStatus *json_glib_parse(const gchar *data, gsize data_length) {
+  g_autoptr(JsonParser) parser = json_parser_new();
+  if (!json_parser_load_from_data(parser, data, data_length, NULL)) {
+    return NULL;
+  }
+  JsonObject *status = json_node_get_object(json_parser_get_root(parser));
+
+  gboolean attached = json_object_has_member(status, "attached") &&
+                      json_object_get_boolean_member(status, "attached");
+
+  g_autoptr(UaStatusBuilder) builder = ua_status_builder_new();
+  ua_status_builder_set_attached(builder, attached);
+  JsonArray *services_array = json_object_get_array_member(status, "services");
+  for (guint i = 0; i < json_array_get_length(services_array); i++) {
+    JsonObject *s = json_array_get_object_element(services_array, i);
+
+    if (g_strcmp0(get_string_member_with_default(s, "available", ""), "yes") !=
+        0) {
+      continue;
+    }
+
+    ua_status_builder_add_service(
+        builder, get_string_member_with_default(s, "name", ""),
+        get_string_member_with_default(s, "description", ""),
+        get_string_member_with_default(s, "entitled", ""),
+        get_string_member_with_default(s, "status", ""));
+  }
+
+  return ua_status_builder_end(builder);
+}
+
+static UaStatus *status_parser_parse(const gchar *data, gsize data_length) {
+  return ua_status_parse(data, data_length, NULL);
+}
+
+static void run(const gchar *name,
+                UaStatus *(*parse)(const gchar *data, gsize data_length),
+                const gchar *json, guint n_services) {
+  gsize json_length = strlen(json);
+
+  // Warm up, and check the result is as expected.
+  g_autoptr(UaStatus) status = parse(json, json_length);
+  g_assert_nonnull(status);
+  g_assert_cmpint(ua_status_get_n_services(status), ==,
+                  n_services - n_services / 4);
+
+  guint64 allocations_start = n_allocations;
+  gint64 start = g_get_monotonic_time();
+  for (int i = 0; i < N_ITERATIONS; i++) {
+    ua_status_unref(parse(json, json_length));
+  }
+  gint64 duration = g_get_monotonic_time() - start;
+  guint64 allocations = n_allocations - allocations_start;
+
+  g_print("%-14s %4u services %7" G_GSIZE_FORMAT " bytes: %8.1f µs/parse, "
+          "%7.1f allocations/parse\n",
+          name, n_services, json_length, (double)duration / N_ITERATIONS,
+          (double)allocations / N_ITERATIONS);
+}
+
+// Find a service by scanning all services, as snapshots did before they were
+// indexed by name, for comparison.
+static UaService *linear_get_service(UaStatus *status, const gchar *name) {
+  for (guint i = 0; i < ua_status_get_n_services(status); i++) {
+    UaService *service = ua_status_get_service_by_index(status, i);
+    if (g_strcmp0(ua_service_get_name(service), name) == 0) {
+      return service;
+    }
+  }
+  return NULL;
+}
+
+// Time matching every service in one snapshot against another, as done when
+// reconciling the exported services with a new status.
+static void run_lookup(const gchar *name,
+                       UaService *(*get_service)(UaStatus *status,
+                                                 const gchar *name),
+                       const gchar *json, guint n_services) {
+  g_autoptr(UaStatus) old_status = status_parser_parse(json, strlen(json));
+  g_autoptr(UaStatus) new_status = status_parser_parse(json, strlen(json));
+  guint n = ua_status_get_n_services(new_status);
+
+  gint64 start = g_get_monotonic_time();
+  for (int i = 0; i < N_ITERATIONS; i++) {
+    for (guint j = 0; j < n; j++) {
+      UaService *service = ua_status_get_service_by_index(new_status, j);
+      g_assert_nonnull(get_service(old_status, ua_service_get_name(service)));
+    }
+  }
+  gint64 duration = g_get_monotonic_time() - start;
+
+  g_print("%-14s %4u services: %8.1f µs/reconcile\n", name, n_services,
+          (double)duration / N_ITERATIONS);
+}
+
+int main(int argc, char **argv) {
+  guint sizes[] = {8, 32, 128, 512};
+
+  for (guint i = 0; i < G_N_ELEMENTS(sizes); i++) {
+    g_autofree gchar *json = make_status_json(sizes[i]);
+    run("json-glib", json_glib_parse, json, sizes[i]);
+    run("status-parser", status_parser_parse, json, sizes[i]);
+    run_lookup("linear lookup", linear_get_service, json, sizes[i]);
+    run_lookup("hash lookup", ua_status_get_service, json, sizes[i]);
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -33,6 +33,11 @@ static void update_status(JsonObject *status) {
 
   const gchar *status_file = getenv("MOCK_UA_STATUS_FILE");
 
+  // Simulate pro being slow to write the status file.
+  if (getenv("MOCK_UA_NO_STATUS_UPDATE") != NULL) {
+    return;
+  }
+
   g_autoptr(GError) error = NULL;
   if (!g_file_set_contents(status_file, status_json, -1, &error)) {
     g_printerr("Failed to write status: %s\n", error->message);
@@ -147,44 +152,94 @@ static JsonObject *find_service(JsonObject *status, const char *name) {
   return NULL;
 }
 
-static int disable(int argc, char **argv) {
-  if (argc != 2 || strcmp(argv[0], "--assume-yes") != 0) {
-    g_printerr("Invalid args\n");
-    return EXIT_FAILURE;
-  }
-  const char *name = argv[1];
-
-  g_autoptr(JsonObject) status = get_status();
-  JsonObject *service = find_service(status, name);
-  if (service == NULL) {
-    g_printerr("Unknown service\n");
-    return EXIT_FAILURE;
-  }
+// Set the status of the services named in [argv] to [value]. With
+// --format json the results are written to stdout as pro does.
+static int set_services_status(int argc, char **argv, const char *value) {
+  g_autoptr(GError) error = NULL;
+  gboolean assume_yes = FALSE;
+  g_autofree char *format = NULL;
 
-  json_object_set_string_member(service, "status", "disabled");
-  update_status(status);
+  const GOptionEntry options_entries[] = {
+      {"assume-yes", 0, 0, G_OPTION_ARG_NONE, &assume_yes, NULL, NULL},
+      {"format", 0, 0, G_OPTION_ARG_STRING, &format, NULL, NULL},
+      {NULL},
+  };
 
-  return EXIT_SUCCESS;
-}
+  g_autoptr(GOptionContext) options_context =
+      g_option_context_new("<service> [flags]");
+  g_option_context_add_main_entries(options_context, options_entries, NULL);
 
-static int enable(int argc, char **argv) {
-  if (argc != 2 || strcmp(argv[0], "--assume-yes") != 0) {
+  if (!g_option_context_parse(options_context, &argc, &argv, &error)) {
+    g_critical("Options parse error: %s", error->message);
+    return EXIT_FAILURE;
+  }
+  if (!assume_yes || argc < 3) {
     g_printerr("Invalid args\n");
     return EXIT_FAILURE;
   }
-  const char *name = argv[1];
+  gboolean json_output = g_strcmp0(format, "json") == 0;
 
   g_autoptr(JsonObject) status = get_status();
-  JsonObject *service = find_service(status, name);
-  if (service == NULL) {
-    g_printerr("Unknown service\n");
-    return EXIT_FAILURE;
-  }
+  g_autoptr(JsonArray) processed_services = json_array_new();
+  g_autoptr(JsonArray) failed_services = json_array_new();
+  g_autoptr(JsonArray) errors = json_array_new();
+  for (int i = 2; i < argc; i++) {
+    const char *name = argv[i];
+    const char *message = NULL;
+
+    JsonObject *service = find_service(status, name);
+    if (service == NULL) {
+      message = "Unknown service";
+    } else if (g_strcmp0(json_object_get_string_member(service, "status"),
+                         value) == 0) {
+      message = strcmp(value, "enabled") == 0 ? "Service already enabled"
+                                              : "Service already disabled";
+    }
 
-  json_object_set_string_member(service, "status", "enabled");
+    if (message != NULL) {
+      if (!json_output) {
+        g_printerr("%s\n", message);
+      }
+      json_array_add_string_element(failed_services, name);
+      JsonObject *e = json_object_new();
+      json_object_set_string_member(e, "message", message);
+      json_object_set_string_member(e, "service", name);
+      json_object_set_string_member(e, "type", "service");
+      json_array_add_object_element(errors, e);
+      continue;
+    }
+
+    json_object_set_string_member(service, "status", value);
+    json_array_add_string_element(processed_services, name);
+    if (!json_output) {
+      g_print("%s %s\n", name, value);
+    }
+  }
   update_status(status);
 
-  return EXIT_SUCCESS;
+  gboolean success = json_array_get_length(failed_services) == 0;
+  if (json_output) {
+    g_autoptr(JsonObject) result = json_object_new();
+    json_object_set_string_member(result, "_schema_version", "0.1");
+    json_object_set_array_member(result, "errors", json_array_ref(errors));
+    json_object_set_array_member(result, "failed_services",
+                                 json_array_ref(failed_services));
+    json_object_set_boolean_member(result, "needs_reboot", FALSE);
+    json_object_set_array_member(result, "processed_services",
+                                 json_array_ref(processed_services));
+    json_object_set_string_member(result, "result",
+                                  success ? "success" : "failure");
+    json_object_set_array_member(result, "warnings", json_array_new());
+
+    g_autoptr(JsonGenerator) generator = json_generator_new();
+    g_autoptr(JsonNode) root = json_node_new(JSON_NODE_OBJECT);
+    json_node_set_object(root, result);
+    json_generator_set_root(generator, root);
+    g_autofree gchar *result_json = json_generator_to_data(generator, NULL);
+    g_print("%s\n", result_json);
+  }
+
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 static int usage() {
@@ -193,6 +248,24 @@ static int usage() {
 }
 
 int main(int argc, char **argv) {
+  // Simulate pro taking a long time, so it can be cancelled. If set to the
+  // absolute path of a file, carry on once that file is removed.
+  const char *hang = getenv("MOCK_UA_HANG");
+  if (hang != NULL) {
+    g_printerr("Waiting for lock\n");
+    while (!g_path_is_absolute(hang) ||
+           g_file_test(hang, G_FILE_TEST_EXISTS)) {
+      g_usleep(G_USEC_PER_SEC / 10);
+    }
+  }
+
+  // Simulate a progress meter that redraws its line in place, followed by
+  // a line too long to report in full.
+  if (getenv("MOCK_UA_PROGRESS") != NULL) {
+    g_autofree gchar *long_line = g_strnfill(5000, 'x');
+    g_print("Installing 50%%\rInstalling 100%%\r\n%s\n", long_line);
+  }
+
   const char *command = "";
   int command_argc = 0;
   char **command_argv = NULL;
@@ -206,9 +279,9 @@ int main(int argc, char **argv) {
   } else if (g_strcmp0(command, "detach") == 0) {
     return detach(command_argc, command_argv);
   } else if (g_strcmp0(command, "disable") == 0) {
-    return disable(command_argc, command_argv);
+    return set_services_status(argc, argv, "disabled");
   } else if (g_strcmp0(command, "enable") == 0) {
-    return enable(command_argc, command_argv);
+    return set_services_status(argc, argv, "enabled");
   } else {
     return usage();
   }
@@ -0,0 +1,89 @@
+#include <gio/gio.h>
+#include <string.h>
+
+#include "test-daemon.h"
+
+static gboolean enable_cancelled = FALSE;
+static gboolean cancel_complete = FALSE;
+static gboolean cancel_requested = FALSE;
+
+static void check_complete() {
+  if (enable_cancelled && cancel_complete) {
+    test_daemon_success();
+  }
+}
+
+static void cancel_cb(GObject *object, GAsyncResult *result,
+                      gpointer user_data) {
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GVariant) r =
+      g_dbus_connection_call_finish(G_DBUS_CONNECTION(object), result, &error);
+  if (r == NULL) {
+    g_warning("Failed to cancel: %s\n", error->message);
+    test_daemon_failure();
+    return;
+  }
+
+  cancel_complete = TRUE;
+  check_complete();
+}
+
+static void enable_cb(GObject *object, GAsyncResult *result,
+                      gpointer user_data) {
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GVariant) r =
+      g_dbus_connection_call_finish(G_DBUS_CONNECTION(object), result, &error);
+  if (r != NULL) {
+    g_warning("Enable succeeded when cancelled\n");
+    test_daemon_failure();
+    return;
+  }
+
+  g_autofree gchar *error_name = g_dbus_error_get_remote_error(error);
+  if (g_strcmp0(error_name, "com.canonical.UbuntuAdvantage.Cancelled") != 0) {
+    g_warning("Enable failed with unexpected error: %s\n", error->message);
+    test_daemon_failure();
+    return;
+  }
+
+  enable_cancelled = TRUE;
+  check_complete();
+}
+
+// Called when the pro command for Enable() reports progress, so is running.
+static void progress_cb(GDBusConnection *connection, const gchar *sender_name,
+                        const gchar *object_path, const gchar *interface_name,
+                        const gchar *signal_name, GVariant *parameters,
+                        gpointer user_data) {
+  if (cancel_requested) {
+    return;
+  }
+  cancel_requested = TRUE;
+
+  g_dbus_connection_call(
+      connection, "com.canonical.UbuntuAdvantage",
+      "/com/canonical/UbuntuAdvantage/Manager",
+      "com.canonical.UbuntuAdvantage.Manager", "Cancel", g_variant_new("()"),
+      G_VARIANT_TYPE("()"), G_DBUS_CALL_FLAGS_NONE, -1, NULL, cancel_cb, NULL);
+}
+
+static void daemon_ready_cb(GDBusConnection *connection) {
+  g_dbus_connection_signal_subscribe(
+      connection, "com.canonical.UbuntuAdvantage",
+      "com.canonical.UbuntuAdvantage.Manager", "Progress",
+      "/com/canonical/UbuntuAdvantage/Manager", NULL, G_DBUS_SIGNAL_FLAGS_NONE,
+      progress_cb, NULL, NULL);
+
+  g_dbus_connection_call(connection, "com.canonical.UbuntuAdvantage",
+                         "/com/canonical/UbuntuAdvantage/Services/esm_2dapps",
+                         "com.canonical.UbuntuAdvantage.Service", "Enable",
+                         g_variant_new("()"), G_VARIANT_TYPE("()"),
+                         G_DBUS_CALL_FLAGS_NONE, -1, NULL, enable_cb, NULL);
+}
+
+int main(int argc, char **argv) {
+  // pro runs until it is terminated.
+  g_setenv("MOCK_UA_HANG", "1", TRUE);
+
+  return test_daemon_run(FALSE, FALSE, daemon_ready_cb, NULL, NULL);
+}
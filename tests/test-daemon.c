@@ -9,9 +9,12 @@
 static TestDaemonReadyFunction ready_callback;
 static TestDaemonAttachedChangedFunction attached_changed_callback;
 static TestDaemonServiceStatusChangedFunction service_status_changed_callback;
+static TestDaemonAuthorizedFunction authorized_callback = NULL;
 static GMainLoop *loop = NULL;
 static gchar *temp_dir = NULL;
 static gchar *status_path = NULL;
+static gchar *cache_path = NULL;
+static GPtrArray *daemon_arguments = NULL;
 static GDBusConnection *connection = NULL;
 static pid_t bus_pid = -1;
 static gchar *daemon_dbus_name = NULL;
@@ -23,6 +26,9 @@ static void cleanup() {
   if (status_path != NULL) {
     unlink(status_path);
   }
+  if (cache_path != NULL) {
+    unlink(cache_path);
+  }
   if (temp_dir != NULL) {
     rmdir(temp_dir);
   }
@@ -83,7 +89,8 @@ static void dbus_signal_cb(GDBusConnection *connection,
       if (strcmp(signal_name, "NameOwnerChanged") == 0) {
         const gchar *name, *old_owner, *new_owner;
         g_variant_get(parameters, "(&s&s&s)", &name, &old_owner, &new_owner);
-        if (strcmp(name, "com.canonical.UbuntuAdvantage") == 0) {
+        if (strcmp(name, "com.canonical.UbuntuAdvantage") == 0 &&
+            new_owner[0] != '\0') {
           daemon_dbus_name = strdup(new_owner);
           ready_callback(connection);
         }
@@ -100,8 +107,13 @@ polkit_method_call_cb(GDBusConnection *connection, const gchar *sender,
   if (strcmp(object_path, "/org/freedesktop/PolicyKit1/Authority") == 0 &&
       strcmp(interface_name, "org.freedesktop.PolicyKit1.Authority") == 0 &&
       strcmp(method_name, "CheckAuthorization") == 0) {
+    g_autofree gchar *action_id = NULL;
+    g_variant_get_child(parameters, 1, "s", &action_id);
     g_dbus_method_invocation_return_value(
         invocation, g_variant_new("((bba{ss}))", TRUE, TRUE, NULL));
+    if (authorized_callback != NULL) {
+      authorized_callback(action_id);
+    }
   } else {
     g_dbus_method_invocation_return_dbus_error(
         invocation, "org.freedesktop.DBus.Error.UnknownMethod",
@@ -214,6 +226,7 @@ int test_daemon_run(
     return EXIT_FAILURE;
   }
   status_path = g_build_filename(temp_dir, "status.json", NULL);
+  cache_path = g_build_filename(temp_dir, "status-cache", NULL);
   g_autoptr(JsonBuilder) builder = json_builder_new();
   json_builder_begin_object(builder);
 
@@ -287,8 +300,19 @@ int test_daemon_run(
       DAEMON_BUILDDIR, "ubuntu-advantage-desktop-daemon", NULL);
   g_autofree gchar *status_path_arg =
       g_strdup_printf("--status-path=%s", status_path);
-  g_autoptr(GSubprocess) subprocess = g_subprocess_launcher_spawn(
-      launcher, &error, daemon_path, status_path_arg, NULL);
+  g_autofree gchar *cache_path_arg =
+      g_strdup_printf("--cache-path=%s", cache_path);
+  g_autoptr(GPtrArray) argv = g_ptr_array_new();
+  g_ptr_array_add(argv, daemon_path);
+  g_ptr_array_add(argv, status_path_arg);
+  g_ptr_array_add(argv, cache_path_arg);
+  for (guint i = 0; daemon_arguments != NULL && i < daemon_arguments->len;
+       i++) {
+    g_ptr_array_add(argv, g_ptr_array_index(daemon_arguments, i));
+  }
+  g_ptr_array_add(argv, NULL);
+  g_autoptr(GSubprocess) subprocess = g_subprocess_launcher_spawnv(
+      launcher, (const gchar *const *)argv->pdata, &error);
   if (subprocess == NULL) {
     g_warning("Failed launch daemon %s: %s", daemon_path, error->message);
     cleanup();
@@ -302,6 +326,18 @@ int test_daemon_run(
   return exit_result;
 }
 
+void test_daemon_add_argument(const gchar *argument) {
+  if (daemon_arguments == NULL) {
+    daemon_arguments = g_ptr_array_new_with_free_func(g_free);
+  }
+  g_ptr_array_add(daemon_arguments, g_strdup(argument));
+}
+
+void test_daemon_set_authorized_function(
+    TestDaemonAuthorizedFunction function) {
+  authorized_callback = function;
+}
+
 void test_daemon_failure() {
   exit_result = EXIT_FAILURE;
   g_main_loop_quit(loop);
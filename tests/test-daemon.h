@@ -6,6 +6,7 @@ typedef void (*TestDaemonReadyFunction)(GDBusConnection *connection);
 typedef void (*TestDaemonAttachedChangedFunction)(gboolean attached);
 typedef void (*TestDaemonServiceStatusChangedFunction)(const gchar *service,
                                                        const gchar *status);
+typedef void (*TestDaemonAuthorizedFunction)(const gchar *action_id);
 
 int test_daemon_run(
     gboolean attached, gboolean esm_apps_enabled,
@@ -13,6 +14,14 @@ int test_daemon_run(
     TestDaemonAttachedChangedFunction attached_changed_function,
     TestDaemonServiceStatusChangedFunction service_status_changed_function);
 
+// Pass an additional command line [argument] to the daemon. Must be called
+// before test_daemon_run().
+void test_daemon_add_argument(const gchar *argument);
+
+// Call [function] each time the mock polkit authorizes an action. Must be
+// called before test_daemon_run().
+void test_daemon_set_authorized_function(TestDaemonAuthorizedFunction function);
+
 void test_daemon_failure();
 
 void test_daemon_success();
@@ -0,0 +1,95 @@
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+
+#include "test-daemon.h"
+
+// File that holds the mock pro until it is removed.
+static gchar *lock_path = NULL;
+
+static int n_authorized = 0;
+static gboolean pro_running = FALSE;
+static int n_replies = 0;
+
+// Let pro complete once it is running and both requests have been
+// authorized, so the second request joins the first one's command.
+static void release_pro() {
+  if (n_authorized < 2 || !pro_running || lock_path == NULL) {
+    return;
+  }
+
+  g_unlink(lock_path);
+  g_clear_pointer(&lock_path, g_free);
+}
+
+static void authorized_cb(const gchar *action_id) {
+  n_authorized++;
+  release_pro();
+}
+
+static void progress_cb(GDBusConnection *connection, const gchar *sender_name,
+                        const gchar *object_path, const gchar *interface_name,
+                        const gchar *signal_name, GVariant *parameters,
+                        gpointer user_data) {
+  pro_running = TRUE;
+  release_pro();
+}
+
+static void enable_cb(GObject *object, GAsyncResult *result,
+                      gpointer user_data) {
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GVariant) r =
+      g_dbus_connection_call_finish(G_DBUS_CONNECTION(object), result, &error);
+  if (r == NULL) {
+    g_warning("Failed to enable: %s\n", error->message);
+    test_daemon_failure();
+    return;
+  }
+
+  // Both requests complete from the one pro command.
+  n_replies++;
+  if (n_replies == 2) {
+    test_daemon_success();
+  }
+}
+
+static void enable(GDBusConnection *connection) {
+  g_dbus_connection_call(connection, "com.canonical.UbuntuAdvantage",
+                         "/com/canonical/UbuntuAdvantage/Services/esm_2dapps",
+                         "com.canonical.UbuntuAdvantage.Service", "Enable",
+                         g_variant_new("()"), G_VARIANT_TYPE("()"),
+                         G_DBUS_CALL_FLAGS_NONE, -1, NULL, enable_cb, NULL);
+}
+
+static void daemon_ready_cb(GDBusConnection *connection) {
+  g_dbus_connection_signal_subscribe(
+      connection, "com.canonical.UbuntuAdvantage",
+      "com.canonical.UbuntuAdvantage.Manager", "Progress",
+      "/com/canonical/UbuntuAdvantage/Manager", NULL, G_DBUS_SIGNAL_FLAGS_NONE,
+      progress_cb, NULL, NULL);
+
+  // The mock pro fails if the service is already enabled, so the second
+  // request fails if it runs its own command.
+  enable(connection);
+  enable(connection);
+}
+
+int main(int argc, char **argv) {
+  // pro waits until the lock file is removed.
+  g_autoptr(GError) error = NULL;
+  int fd = g_file_open_tmp("uad-lock-XXXXXX", &lock_path, &error);
+  if (fd < 0) {
+    g_warning("Failed to create lock file: %s", error->message);
+    return EXIT_FAILURE;
+  }
+  g_close(fd, NULL);
+  g_setenv("MOCK_UA_HANG", lock_path, TRUE);
+
+  test_daemon_set_authorized_function(authorized_cb);
+  int result = test_daemon_run(FALSE, FALSE, daemon_ready_cb, NULL, NULL);
+
+  if (lock_path != NULL) {
+    g_unlink(lock_path);
+  }
+
+  return result;
+}
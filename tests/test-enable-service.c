@@ -3,18 +3,57 @@
 
 #include "test-daemon.h"
 
+static gboolean status_changed = FALSE;
+
+static void get_status_cb(GObject *object, GAsyncResult *result,
+                          gpointer user_data) {
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GVariant) r =
+      g_dbus_connection_call_finish(G_DBUS_CONNECTION(object), result, &error);
+  if (r == NULL) {
+    g_warning("Failed to get service status: %s\n", error->message);
+    test_daemon_failure();
+    return;
+  }
+
+  g_autoptr(GVariant) value = NULL;
+  g_variant_get(r, "(v)", &value);
+  const gchar *status = g_variant_get_string(value, NULL);
+  if (strcmp(status, "enabled") != 0) {
+    g_warning("Service status is %s after enabling\n", status);
+    test_daemon_failure();
+    return;
+  }
+
+  test_daemon_success();
+}
+
 static void enable_cb(GObject *object, GAsyncResult *result,
                       gpointer user_data) {
+  GDBusConnection *connection = G_DBUS_CONNECTION(object);
+
   g_autoptr(GError) error = NULL;
   g_autoptr(GVariant) r =
-      g_dbus_connection_call_finish(G_DBUS_CONNECTION(object), result, &error);
+      g_dbus_connection_call_finish(connection, result, &error);
   if (r == NULL) {
     g_warning("Failed to enable: %s\n", error->message);
     test_daemon_failure();
     return;
   }
 
-  // Wait for service to change status.
+  // The service status is updated before the reply is sent.
+  if (!status_changed) {
+    g_warning("Service status not changed before reply\n");
+    test_daemon_failure();
+    return;
+  }
+  g_dbus_connection_call(
+      connection, "com.canonical.UbuntuAdvantage",
+      "/com/canonical/UbuntuAdvantage/Services/esm_2dapps",
+      "org.freedesktop.DBus.Properties", "Get",
+      g_variant_new("(ss)", "com.canonical.UbuntuAdvantage.Service", "Status"),
+      G_VARIANT_TYPE("(v)"), G_DBUS_CALL_FLAGS_NONE, -1, NULL, get_status_cb,
+      NULL);
 }
 
 static void daemon_ready_cb(GDBusConnection *connection) {
@@ -28,7 +67,7 @@ static void daemon_ready_cb(GDBusConnection *connection) {
 static void service_status_changed_cb(const gchar *service,
                                       const gchar *status) {
   if (strcmp(service, "esm_2dapps") == 0 && strcmp(status, "enabled") == 0) {
-    test_daemon_success();
+    status_changed = TRUE;
   }
 }
 
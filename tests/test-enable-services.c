@@ -0,0 +1,52 @@
+#include <gio/gio.h>
+
+#include "test-daemon.h"
+
+static void enable_services_cb(GObject *object, GAsyncResult *result,
+                               gpointer user_data) {
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GVariant) r =
+      g_dbus_connection_call_finish(G_DBUS_CONNECTION(object), result, &error);
+  if (r == NULL) {
+    g_warning("Failed to enable services: %s\n", error->message);
+    test_daemon_failure();
+    return;
+  }
+
+  g_autoptr(GVariantIter) results = NULL;
+  g_variant_get(r, "(a(sbs))", &results);
+  const gchar *name, *message;
+  gboolean success;
+  gboolean valid_esm_apps = FALSE, valid_unknown = FALSE;
+  int n_results = 0;
+  while (g_variant_iter_loop(results, "(&sb&s)", &name, &success, &message)) {
+    if (g_strcmp0(name, "esm-apps") == 0) {
+      valid_esm_apps = success && g_strcmp0(message, "") == 0;
+    } else if (g_strcmp0(name, "unknown") == 0) {
+      valid_unknown = !success && g_strcmp0(message, "") != 0;
+    }
+    n_results++;
+  }
+
+  if (n_results != 2 || !valid_esm_apps || !valid_unknown) {
+    g_warning("Invalid service results\n");
+    test_daemon_failure();
+    return;
+  }
+
+  test_daemon_success();
+}
+
+static void daemon_ready_cb(GDBusConnection *connection) {
+  const gchar *services[] = {"esm-apps", "unknown", NULL};
+  g_dbus_connection_call(
+      connection, "com.canonical.UbuntuAdvantage",
+      "/com/canonical/UbuntuAdvantage/Manager",
+      "com.canonical.UbuntuAdvantage.Manager", "EnableServices",
+      g_variant_new("(^as)", services), G_VARIANT_TYPE("(a(sbs))"),
+      G_DBUS_CALL_FLAGS_NONE, -1, NULL, enable_services_cb, NULL);
+}
+
+int main(int argc, char **argv) {
+  return test_daemon_run(FALSE, FALSE, daemon_ready_cb, NULL, NULL);
+}
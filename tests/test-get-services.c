@@ -0,0 +1,102 @@
+#include <gio/gio.h>
+#include <string.h>
+
+#include "test-daemon.h"
+
+static void get_entitled_services_cb(GObject *object, GAsyncResult *result,
+                                     gpointer user_data) {
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GVariant) r =
+      g_dbus_connection_call_finish(G_DBUS_CONNECTION(object), result, &error);
+  if (r == NULL) {
+    g_warning("Failed to get services: %s\n", error->message);
+    test_daemon_failure();
+    return;
+  }
+
+  g_autoptr(GVariantIter) services = NULL;
+  g_variant_get(r, "(a(ssss))", &services);
+  const gchar *name, *description, *entitled, *status;
+  gboolean valid = g_variant_iter_n_children(services) == 1 &&
+                   g_variant_iter_next(services, "(&s&s&s&s)", &name,
+                                       &description, &entitled, &status) &&
+                   strcmp(name, "esm-apps") == 0 &&
+                   strcmp(entitled, "yes") == 0 &&
+                   strcmp(status, "disabled") == 0;
+  if (!valid) {
+    g_warning("Invalid entitled services\n");
+    test_daemon_failure();
+    return;
+  }
+
+  test_daemon_success();
+}
+
+static void get_services_cb(GObject *object, GAsyncResult *result,
+                            gpointer user_data) {
+  GDBusConnection *connection = G_DBUS_CONNECTION(object);
+
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GVariant) r =
+      g_dbus_connection_call_finish(connection, result, &error);
+  if (r == NULL) {
+    g_warning("Failed to get services: %s\n", error->message);
+    test_daemon_failure();
+    return;
+  }
+
+  gboolean valid_livepatch_service = FALSE, valid_esm_apps_service = FALSE;
+  g_autoptr(GVariantIter) services = NULL;
+  g_variant_get(r, "(a(ssss))", &services);
+  const gchar *name, *description, *entitled, *status;
+  while (g_variant_iter_next(services, "(&s&s&s&s)", &name, &description,
+                             &entitled, &status)) {
+    if (strcmp(name, "esm-apps") == 0) {
+      const gchar *expected_description =
+          "UA Apps: Extended Security Maintenance (ESM)";
+      valid_esm_apps_service = strcmp(description, expected_description) == 0 &&
+                               strcmp(entitled, "yes") == 0 &&
+                               strcmp(status, "disabled") == 0;
+    } else if (strcmp(name, "livepatch") == 0) {
+      valid_livepatch_service =
+          strcmp(description, "Canonical Livepatch service") == 0 &&
+          strcmp(entitled, "no") == 0 && strcmp(status, "n/a") == 0;
+    } else {
+      g_warning("Unexpected service %s\n", name);
+      test_daemon_failure();
+      return;
+    }
+  }
+
+  if (!valid_livepatch_service || !valid_esm_apps_service) {
+    g_warning("Invalid/missing services\n");
+    test_daemon_failure();
+    return;
+  }
+
+  GVariantBuilder filter;
+  g_variant_builder_init(&filter, G_VARIANT_TYPE("a{sv}"));
+  g_variant_builder_add(&filter, "{sv}", "entitled",
+                        g_variant_new_string("yes"));
+  g_dbus_connection_call(
+      connection, "com.canonical.UbuntuAdvantage",
+      "/com/canonical/UbuntuAdvantage/Manager",
+      "com.canonical.UbuntuAdvantage.Manager", "GetServices",
+      g_variant_new("(a{sv})", &filter), G_VARIANT_TYPE("(a(ssss))"),
+      G_DBUS_CALL_FLAGS_NONE, -1, NULL, get_entitled_services_cb, NULL);
+}
+
+static void daemon_ready_cb(GDBusConnection *connection) {
+  g_dbus_connection_call(
+      connection, "com.canonical.UbuntuAdvantage",
+      "/com/canonical/UbuntuAdvantage/Manager",
+      "com.canonical.UbuntuAdvantage.Manager", "GetServices",
+      g_variant_new("(@a{sv})",
+                    g_variant_new_array(G_VARIANT_TYPE("{sv}"), NULL, 0)),
+      G_VARIANT_TYPE("(a(ssss))"),
+      G_DBUS_CALL_FLAGS_NONE, -1, NULL, get_services_cb, NULL);
+}
+
+int main(int argc, char **argv) {
+  return test_daemon_run(FALSE, FALSE, daemon_ready_cb, NULL, NULL);
+}
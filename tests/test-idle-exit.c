@@ -0,0 +1,50 @@
+#include <gio/gio.h>
+
+#include "test-daemon.h"
+
+static gboolean got_services = FALSE;
+
+static void name_vanished_cb(GDBusConnection *connection, const gchar *name,
+                             gpointer user_data) {
+  if (!got_services) {
+    g_warning("Daemon exited before completing call\n");
+    test_daemon_failure();
+    return;
+  }
+
+  test_daemon_success();
+}
+
+static void get_services_cb(GObject *object, GAsyncResult *result,
+                            gpointer user_data) {
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GVariant) r =
+      g_dbus_connection_call_finish(G_DBUS_CONNECTION(object), result, &error);
+  if (r == NULL) {
+    g_warning("Failed to get services: %s\n", error->message);
+    test_daemon_failure();
+    return;
+  }
+  got_services = TRUE;
+
+  // Wait for the daemon to exit.
+}
+
+static void daemon_ready_cb(GDBusConnection *connection) {
+  g_bus_watch_name_on_connection(connection, "com.canonical.UbuntuAdvantage",
+                                 G_BUS_NAME_WATCHER_FLAGS_NONE, NULL,
+                                 name_vanished_cb, NULL, NULL);
+  g_dbus_connection_call(
+      connection, "com.canonical.UbuntuAdvantage",
+      "/com/canonical/UbuntuAdvantage/Manager",
+      "com.canonical.UbuntuAdvantage.Manager", "GetServices",
+      g_variant_new("(@a{sv})",
+                    g_variant_new_array(G_VARIANT_TYPE("{sv}"), NULL, 0)),
+      G_VARIANT_TYPE("(a(ssss))"), G_DBUS_CALL_FLAGS_NONE, -1, NULL,
+      get_services_cb, NULL);
+}
+
+int main(int argc, char **argv) {
+  test_daemon_add_argument("--idle-timeout=1");
+  return test_daemon_run(FALSE, FALSE, daemon_ready_cb, NULL, NULL);
+}
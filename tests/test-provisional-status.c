@@ -0,0 +1,49 @@
+#include <gio/gio.h>
+#include <string.h>
+
+#include "test-daemon.h"
+
+static gboolean esm_apps_enabled = FALSE;
+
+static void enable_cb(GObject *object, GAsyncResult *result,
+                      gpointer user_data) {
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GVariant) r =
+      g_dbus_connection_call_finish(G_DBUS_CONNECTION(object), result, &error);
+  if (r == NULL) {
+    g_warning("Failed to enable: %s\n", error->message);
+    test_daemon_failure();
+    return;
+  }
+
+  // The status file is not rewritten, so the new status comes from the result
+  // of the command, and is sent before the reply.
+  if (!esm_apps_enabled) {
+    g_warning("Service status not changed before reply\n");
+    test_daemon_failure();
+    return;
+  }
+
+  test_daemon_success();
+}
+
+static void daemon_ready_cb(GDBusConnection *connection) {
+  g_dbus_connection_call(connection, "com.canonical.UbuntuAdvantage",
+                         "/com/canonical/UbuntuAdvantage/Services/esm_2dapps",
+                         "com.canonical.UbuntuAdvantage.Service", "Enable",
+                         g_variant_new("()"), G_VARIANT_TYPE("()"),
+                         G_DBUS_CALL_FLAGS_NONE, -1, NULL, enable_cb, NULL);
+}
+
+static void service_status_changed_cb(const gchar *service,
+                                      const gchar *status) {
+  if (strcmp(service, "esm_2dapps") == 0 && strcmp(status, "enabled") == 0) {
+    esm_apps_enabled = TRUE;
+  }
+}
+
+int main(int argc, char **argv) {
+  g_setenv("MOCK_UA_NO_STATUS_UPDATE", "1", TRUE);
+  return test_daemon_run(FALSE, FALSE, daemon_ready_cb, NULL,
+                         service_status_changed_cb);
+}
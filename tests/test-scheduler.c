@@ -0,0 +1,204 @@
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+
+#include "config.h"
+#include "ua-scheduler.h"
+
+typedef struct {
+  gboolean complete;
+  gboolean success;
+  GError *error;
+} Result;
+
+static void run_cb(GObject *object, GAsyncResult *result, gpointer user_data) {
+  Result *r = user_data;
+  r->success = ua_scheduler_run_finish(UA_SCHEDULER(object), result, &r->error);
+  r->complete = TRUE;
+}
+
+static void test_supersede() {
+  g_autoptr(UaScheduler) scheduler = ua_scheduler_new(1);
+
+  Result enable_apps = {0}, enable_livepatch = {0}, disable_livepatch = {0};
+  ua_scheduler_run(scheduler, UA_OPERATION_ENABLE, "esm-apps", NULL, run_cb,
+                   &enable_apps);
+  g_assert_cmpint(ua_scheduler_get_queue_depth(scheduler), ==, 0);
+  ua_scheduler_run(scheduler, UA_OPERATION_ENABLE, "livepatch", NULL, run_cb,
+                   &enable_livepatch);
+  g_assert_cmpint(ua_scheduler_get_queue_depth(scheduler), ==, 1);
+
+  // Disabling the queued service makes enabling it moot.
+  ua_scheduler_run(scheduler, UA_OPERATION_DISABLE, "livepatch", NULL, run_cb,
+                   &disable_livepatch);
+  g_assert_false(enable_livepatch.complete);
+  g_assert_cmpint(ua_scheduler_get_queue_depth(scheduler), ==, 1);
+  while (!enable_livepatch.complete) {
+    g_main_context_iteration(NULL, TRUE);
+  }
+  g_assert_false(enable_livepatch.success);
+  g_assert_error(enable_livepatch.error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  g_assert_cmpint(ua_scheduler_get_queue_depth(scheduler), ==, 1);
+
+  while (!enable_apps.complete || !disable_livepatch.complete) {
+    g_main_context_iteration(NULL, TRUE);
+  }
+  g_assert_no_error(enable_apps.error);
+  g_assert_true(enable_apps.success);
+  g_assert_no_error(disable_livepatch.error);
+  g_assert_true(disable_livepatch.success);
+  g_assert_cmpint(ua_scheduler_get_queue_depth(scheduler), ==, 0);
+  g_assert_cmpint(ua_scheduler_get_last_queue_wait(scheduler), >, 0);
+
+  g_clear_error(&enable_livepatch.error);
+}
+
+static void progress_cb(UaScheduler *scheduler, UaOperationType type,
+                        const gchar *const *service_names, const gchar *line,
+                        GCancellable *cancellable, gpointer user_data) {
+  GPtrArray *lines = user_data;
+  g_assert_cmpint(type, ==, UA_OPERATION_DISABLE);
+  g_assert_null(cancellable);
+  g_assert_cmpstr(service_names[0], ==, "esm-apps");
+  g_assert_null(service_names[1]);
+  g_ptr_array_add(lines, g_strdup(line));
+}
+
+static void test_progress() {
+  g_autoptr(UaScheduler) scheduler = ua_scheduler_new(1);
+  g_autoptr(GPtrArray) lines = g_ptr_array_new_with_free_func(g_free);
+  g_signal_connect(scheduler, "progress", G_CALLBACK(progress_cb), lines);
+
+  Result disable_apps = {0};
+  ua_scheduler_run(scheduler, UA_OPERATION_DISABLE, "esm-apps", NULL, run_cb,
+                   &disable_apps);
+  while (!disable_apps.complete) {
+    g_main_context_iteration(NULL, TRUE);
+  }
+  g_assert_no_error(disable_apps.error);
+  g_assert_true(disable_apps.success);
+  g_assert_cmpint(lines->len, ==, 1);
+  g_assert_cmpstr(g_ptr_array_index(lines, 0), ==, "esm-apps disabled");
+}
+
+static void lines_progress_cb(UaScheduler *scheduler, UaOperationType type,
+                              const gchar *const *service_names,
+                              const gchar *line, GCancellable *cancellable,
+                              gpointer user_data) {
+  GPtrArray *lines = user_data;
+  g_ptr_array_add(lines, g_strdup(line));
+}
+
+static void test_progress_lines() {
+  g_autoptr(UaScheduler) scheduler = ua_scheduler_new(1);
+  g_autoptr(GPtrArray) lines = g_ptr_array_new_with_free_func(g_free);
+  g_signal_connect(scheduler, "progress", G_CALLBACK(lines_progress_cb),
+                   lines);
+
+  g_setenv("MOCK_UA_PROGRESS", "1", TRUE);
+  Result enable_apps = {0};
+  ua_scheduler_run(scheduler, UA_OPERATION_ENABLE, "esm-apps", NULL, run_cb,
+                   &enable_apps);
+  g_unsetenv("MOCK_UA_PROGRESS");
+  while (!enable_apps.complete) {
+    g_main_context_iteration(NULL, TRUE);
+  }
+  g_assert_no_error(enable_apps.error);
+  g_assert_true(enable_apps.success);
+
+  // Carriage returns end a line, and long lines are cut off.
+  g_autofree gchar *long_line = g_strnfill(4096, 'x');
+  g_assert_cmpint(lines->len, ==, 4);
+  g_assert_cmpstr(g_ptr_array_index(lines, 0), ==, "Installing 50%");
+  g_assert_cmpstr(g_ptr_array_index(lines, 1), ==, "Installing 100%");
+  g_assert_cmpstr(g_ptr_array_index(lines, 2), ==, long_line);
+  g_assert_cmpstr(g_ptr_array_index(lines, 3), ==, "esm-apps enabled");
+}
+
+static void test_error_output() {
+  g_autoptr(UaScheduler) scheduler = ua_scheduler_new(1);
+
+  // The error includes what pro wrote to stderr.
+  Result enable_unknown = {0};
+  ua_scheduler_run(scheduler, UA_OPERATION_ENABLE, "unknown", NULL, run_cb,
+                   &enable_unknown);
+  while (!enable_unknown.complete) {
+    g_main_context_iteration(NULL, TRUE);
+  }
+  g_assert_false(enable_unknown.success);
+  g_assert_error(enable_unknown.error, G_IO_ERROR, G_IO_ERROR_FAILED);
+  g_assert_cmpstr(enable_unknown.error->message, ==,
+                  "Pro client exited with code 1: Unknown service");
+
+  g_clear_error(&enable_unknown.error);
+}
+
+static void test_cancel() {
+  g_autoptr(UaScheduler) scheduler = ua_scheduler_new(1);
+
+  // pro runs until it is terminated.
+  g_setenv("MOCK_UA_HANG", "1", TRUE);
+  g_autoptr(GCancellable) enable_cancellable = g_cancellable_new();
+  Result enable_apps = {0};
+  ua_scheduler_run(scheduler, UA_OPERATION_ENABLE, "esm-apps",
+                   enable_cancellable, run_cb, &enable_apps);
+  g_unsetenv("MOCK_UA_HANG");
+
+  g_autoptr(GCancellable) disable_cancellable = g_cancellable_new();
+  Result disable_livepatch = {0};
+  ua_scheduler_run(scheduler, UA_OPERATION_DISABLE, "livepatch",
+                   disable_cancellable, run_cb, &disable_livepatch);
+  g_assert_cmpint(ua_scheduler_get_queue_depth(scheduler), ==, 1);
+
+  // A queued job completes without waiting for the one running.
+  g_cancellable_cancel(disable_cancellable);
+  while (!disable_livepatch.complete) {
+    g_main_context_iteration(NULL, TRUE);
+  }
+  g_assert_false(disable_livepatch.success);
+  g_assert_error(disable_livepatch.error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  g_assert_cmpint(ua_scheduler_get_queue_depth(scheduler), ==, 0);
+  g_assert_false(enable_apps.complete);
+
+  // A running job completes once pro has been terminated.
+  g_cancellable_cancel(enable_cancellable);
+  while (!enable_apps.complete) {
+    g_main_context_iteration(NULL, TRUE);
+  }
+  g_assert_false(enable_apps.success);
+  g_assert_error(enable_apps.error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+
+  g_clear_error(&disable_livepatch.error);
+  g_clear_error(&enable_apps.error);
+}
+
+int main(int argc, char **argv) {
+  g_test_init(&argc, &argv, NULL);
+
+  // Run the mock pro on a status file with two services.
+  g_autofree gchar *temp_dir = g_dir_make_tmp("uad-test-XXXXXX", NULL);
+  g_autofree gchar *status_path =
+      g_build_filename(temp_dir, "status.json", NULL);
+  g_assert_true(g_file_set_contents(
+      status_path,
+      "{\"attached\": true, \"services\": ["
+      "{\"name\": \"esm-apps\", \"available\": \"yes\", "
+      "\"status\": \"disabled\"}, "
+      "{\"name\": \"livepatch\", \"available\": \"yes\", "
+      "\"status\": \"enabled\"}]}",
+      -1, NULL));
+  g_setenv("MOCK_UA_STATUS_FILE", status_path, TRUE);
+  g_setenv("PATH", TEST_BUILDDIR, TRUE);
+
+  g_test_add_func("/scheduler/supersede", test_supersede);
+  g_test_add_func("/scheduler/progress", test_progress);
+  g_test_add_func("/scheduler/progress-lines", test_progress_lines);
+  g_test_add_func("/scheduler/error-output", test_error_output);
+  g_test_add_func("/scheduler/cancel", test_cancel);
+
+  int result = g_test_run();
+
+  g_unlink(status_path);
+  g_rmdir(temp_dir);
+
+  return result;
+}
@@ -0,0 +1,78 @@
+#include <gio/gio.h>
+
+#include "test-daemon.h"
+
+static void set_desired_services(GDBusConnection *connection,
+                                 const gchar *const *services,
+                                 GAsyncReadyCallback callback) {
+  g_dbus_connection_call(
+      connection, "com.canonical.UbuntuAdvantage",
+      "/com/canonical/UbuntuAdvantage/Manager",
+      "com.canonical.UbuntuAdvantage.Manager", "SetDesiredServices",
+      g_variant_new("(^as)", services), G_VARIANT_TYPE("(a(sbs))"),
+      G_DBUS_CALL_FLAGS_NONE, -1, NULL, callback, NULL);
+}
+
+static void disable_cb(GObject *object, GAsyncResult *result,
+                       gpointer user_data) {
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GVariant) r =
+      g_dbus_connection_call_finish(G_DBUS_CONNECTION(object), result, &error);
+  if (r == NULL) {
+    g_warning("Failed to set desired services: %s\n", error->message);
+    test_daemon_failure();
+    return;
+  }
+
+  // Only esm-apps needed to be disabled.
+  g_autoptr(GVariant) results = g_variant_get_child_value(r, 0);
+  const gchar *name, *message;
+  gboolean success;
+  if (g_variant_n_children(results) != 1) {
+    g_warning("Unexpected number of results\n");
+    test_daemon_failure();
+    return;
+  }
+  g_variant_get_child(results, 0, "(&sb&s)", &name, &success, &message);
+  if (g_strcmp0(name, "esm-apps") != 0 || !success) {
+    g_warning("Failed to disable esm-apps: %s\n", message);
+    test_daemon_failure();
+    return;
+  }
+
+  test_daemon_success();
+}
+
+static void unchanged_cb(GObject *object, GAsyncResult *result,
+                         gpointer user_data) {
+  GDBusConnection *connection = G_DBUS_CONNECTION(object);
+
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GVariant) r =
+      g_dbus_connection_call_finish(connection, result, &error);
+  if (r == NULL) {
+    g_warning("Failed to set desired services: %s\n", error->message);
+    test_daemon_failure();
+    return;
+  }
+
+  // esm-apps is already enabled, so nothing is changed.
+  g_autoptr(GVariant) results = g_variant_get_child_value(r, 0);
+  if (g_variant_n_children(results) != 0) {
+    g_warning("Unexpected changes to services\n");
+    test_daemon_failure();
+    return;
+  }
+
+  const gchar *services[] = {NULL};
+  set_desired_services(connection, services, disable_cb);
+}
+
+static void daemon_ready_cb(GDBusConnection *connection) {
+  const gchar *services[] = {"esm-apps", NULL};
+  set_desired_services(connection, services, unchanged_cb);
+}
+
+int main(int argc, char **argv) {
+  return test_daemon_run(FALSE, TRUE, daemon_ready_cb, NULL, NULL);
+}
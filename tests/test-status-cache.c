@@ -0,0 +1,85 @@
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+
+#include "ua-status-cache.h"
+
+static gchar *temp_dir = NULL;
+
+static gchar *get_cache_path() {
+  return g_build_filename(temp_dir, "status-cache", NULL);
+}
+
+static void test_round_trip() {
+  g_autofree gchar *path = get_cache_path();
+
+  g_autoptr(UaStatusBuilder) builder = ua_status_builder_new();
+  ua_status_builder_set_attached(builder, TRUE);
+  ua_status_builder_add_service(builder, "esm-apps",
+                                "Expanded Security Maintenance", "yes",
+                                "enabled");
+  ua_status_builder_add_service(builder, "livepatch", "", "maybe", "pending");
+  g_autoptr(UaStatus) status = ua_status_builder_end(builder);
+
+  UaStatusFingerprint fingerprint = {
+      .inode = 42, .size = 1234, .mtime = 5678, .checksum = "abcdef"};
+  g_autoptr(GError) error = NULL;
+  g_assert_true(ua_status_cache_save(path, &fingerprint, status, &error));
+  g_assert_no_error(error);
+
+  UaStatusFingerprint loaded_fingerprint = {0};
+  g_autoptr(UaStatus) loaded_status =
+      ua_status_cache_load(path, &loaded_fingerprint, &error);
+  g_assert_no_error(error);
+  g_assert_nonnull(loaded_status);
+  g_assert_true(ua_status_equal(status, loaded_status));
+  g_assert_cmpint(loaded_fingerprint.inode, ==, 42);
+  g_assert_cmpint(loaded_fingerprint.size, ==, 1234);
+  g_assert_cmpint(loaded_fingerprint.mtime, ==, 5678);
+  g_assert_cmpstr(loaded_fingerprint.checksum, ==, "abcdef");
+  g_free(loaded_fingerprint.checksum);
+
+  g_unlink(path);
+}
+
+static void test_missing() {
+  g_autofree gchar *path = get_cache_path();
+
+  UaStatusFingerprint fingerprint = {0};
+  g_autoptr(GError) error = NULL;
+  g_autoptr(UaStatus) status = ua_status_cache_load(path, &fingerprint, &error);
+  g_assert_null(status);
+  g_assert_error(error, G_FILE_ERROR, G_FILE_ERROR_NOENT);
+  g_assert_null(fingerprint.checksum);
+}
+
+static void test_invalid() {
+  g_autofree gchar *path = get_cache_path();
+  g_assert_true(g_file_set_contents(path, "not a cache", -1, NULL));
+
+  UaStatusFingerprint fingerprint = {0};
+  g_autoptr(GError) error = NULL;
+  g_autoptr(UaStatus) status = ua_status_cache_load(path, &fingerprint, &error);
+  g_assert_null(status);
+  g_assert_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+  g_assert_null(fingerprint.checksum);
+
+  g_unlink(path);
+}
+
+int main(int argc, char **argv) {
+  g_test_init(&argc, &argv, NULL);
+
+  temp_dir = g_dir_make_tmp("uad-test-XXXXXX", NULL);
+  g_assert_nonnull(temp_dir);
+
+  g_test_add_func("/status-cache/round-trip", test_round_trip);
+  g_test_add_func("/status-cache/missing", test_missing);
+  g_test_add_func("/status-cache/invalid", test_invalid);
+
+  int result = g_test_run();
+
+  g_rmdir(temp_dir);
+  g_free(temp_dir);
+
+  return result;
+}
@@ -0,0 +1,78 @@
+#include <gio/gio.h>
+#include <string.h>
+
+#include "test-daemon.h"
+
+static void status_changed_cb(GDBusConnection *connection,
+                              const gchar *sender_name,
+                              const gchar *object_path,
+                              const gchar *interface_name,
+                              const gchar *signal_name, GVariant *parameters,
+                              gpointer user_data) {
+  guint64 generation;
+  gboolean attached;
+  g_autoptr(GVariantIter) added = NULL;
+  g_autofree const gchar **removed = NULL;
+  g_autoptr(GVariantIter) changed = NULL;
+  g_variant_get(parameters, "(tba(ssss)^a&sa{sa{sv}})", &generation, &attached,
+                &added, &removed, &changed);
+
+  if (generation == 0 || attached || g_variant_iter_n_children(added) != 0 ||
+      removed[0] != NULL) {
+    g_warning("Unexpected status change\n");
+    test_daemon_failure();
+    return;
+  }
+
+  const gchar *name;
+  g_autoptr(GVariant) properties = NULL;
+  if (!g_variant_iter_next(changed, "{&s@a{sv}}", &name, &properties)) {
+    g_warning("Missing changed service\n");
+    test_daemon_failure();
+    return;
+  }
+
+  const gchar *status;
+  if (strcmp(name, "esm-apps") != 0 ||
+      g_variant_n_children(properties) != 1 ||
+      !g_variant_lookup(properties, "Status", "&s", &status) ||
+      strcmp(status, "enabled") != 0) {
+    g_warning("Invalid changed service\n");
+    test_daemon_failure();
+    return;
+  }
+
+  test_daemon_success();
+}
+
+static void enable_cb(GObject *object, GAsyncResult *result,
+                      gpointer user_data) {
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GVariant) r =
+      g_dbus_connection_call_finish(G_DBUS_CONNECTION(object), result, &error);
+  if (r == NULL) {
+    g_warning("Failed to enable: %s\n", error->message);
+    test_daemon_failure();
+    return;
+  }
+
+  // Wait for status to change.
+}
+
+static void daemon_ready_cb(GDBusConnection *connection) {
+  g_dbus_connection_signal_subscribe(
+      connection, "com.canonical.UbuntuAdvantage",
+      "com.canonical.UbuntuAdvantage.Manager", "StatusChanged",
+      "/com/canonical/UbuntuAdvantage/Manager", NULL, G_DBUS_SIGNAL_FLAGS_NONE,
+      status_changed_cb, NULL, NULL);
+
+  g_dbus_connection_call(connection, "com.canonical.UbuntuAdvantage",
+                         "/com/canonical/UbuntuAdvantage/Services/esm_2dapps",
+                         "com.canonical.UbuntuAdvantage.Service", "Enable",
+                         g_variant_new("()"), G_VARIANT_TYPE("()"),
+                         G_DBUS_CALL_FLAGS_NONE, -1, NULL, enable_cb, NULL);
+}
+
+int main(int argc, char **argv) {
+  return test_daemon_run(FALSE, FALSE, daemon_ready_cb, NULL, NULL);
+}
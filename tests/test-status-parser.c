@@ -0,0 +1,191 @@
+#include <glib.h>
+#include <string.h>
+
+#include "ua-status-parser.h"
+
+static UaStatus *parse(const gchar *json) {
+  g_autoptr(GError) error = NULL;
+  UaStatus *status = ua_status_parse(json, strlen(json), &error);
+  g_assert_no_error(error);
+  g_assert_nonnull(status);
+  return status;
+}
+
+static void assert_invalid(const gchar *json) {
+  g_autoptr(GError) error = NULL;
+  g_autoptr(UaStatus) status = ua_status_parse(json, strlen(json), &error);
+  g_assert_null(status);
+  g_assert_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+}
+
+static void test_services() {
+  g_autoptr(UaStatus) status =
+      parse("{"
+            "  \"_doc\": \"Content provided in json response\","
+            "  \"account\": {\"name\": \"Account\", \"id\": \"x{}[]\\\"\"},"
+            "  \"attached\": true,"
+            "  \"contract\": {\"products\": [\"a\", \"b\"], \"n\": -1.5e3},"
+            "  \"services\": ["
+            "    {\"available\": \"yes\", \"blocked_by\": [{\"name\": \"x\"}],"
+            "     \"description\": \"Expanded Security Maintenance\","
+            "     \"description_override\": null, \"entitled\": \"yes\","
+            "     \"name\": \"esm-apps\", \"status\": \"enabled\","
+            "     \"warning\": null},"
+            "    {\"available\": \"no\", \"name\": \"unavailable\"},"
+            "    {\"available\": \"yes\", \"name\": \"livepatch\","
+            "     \"entitled\": \"no\", \"status\": \"n/a\"}"
+            "  ],"
+            "  \"notices\": [[\"\", \"notice\"]],"
+            "  \"simulated\": false"
+            "}");
+
+  g_assert_true(ua_status_get_attached(status));
+  g_assert_cmpint(ua_status_get_n_services(status), ==, 2);
+
+  UaService *esm_apps = ua_status_get_service(status, "esm-apps");
+  g_assert_nonnull(esm_apps);
+  g_assert_cmpstr(ua_service_get_description(esm_apps), ==,
+                  "Expanded Security Maintenance");
+  g_assert_cmpstr(ua_service_get_entitled(esm_apps), ==, "yes");
+  g_assert_cmpstr(ua_service_get_status(esm_apps), ==, "enabled");
+  g_assert_cmpint(ua_service_get_entitlement(esm_apps), ==,
+                  UA_SERVICE_ENTITLEMENT_YES);
+  g_assert_cmpint(ua_service_get_state(esm_apps), ==, UA_SERVICE_STATE_ENABLED);
+
+  UaService *livepatch = ua_status_get_service(status, "livepatch");
+  g_assert_nonnull(livepatch);
+  g_assert_cmpstr(ua_service_get_description(livepatch), ==, "");
+  g_assert_cmpstr(ua_service_get_entitled(livepatch), ==, "no");
+  g_assert_cmpstr(ua_service_get_status(livepatch), ==, "n/a");
+  g_assert_cmpint(ua_service_get_entitlement(livepatch), ==,
+                  UA_SERVICE_ENTITLEMENT_NO);
+  g_assert_cmpint(ua_service_get_state(livepatch), ==,
+                  UA_SERVICE_STATE_NOT_APPLICABLE);
+
+  g_assert_null(ua_status_get_service(status, "unavailable"));
+}
+
+static void test_escapes() {
+  g_autoptr(UaStatus) status =
+      parse("{\"services\": [{\"available\": \"yes\", \"name\": \"test\","
+            "\"description\": \"Caf\\u00e9 \\\"quoted\\\"\\n\\ud83d\\ude00\"}]}");
+
+  UaService *service = ua_status_get_service(status, "test");
+  g_assert_nonnull(service);
+  g_assert_cmpstr(ua_service_get_description(service), ==,
+                  "Caf\xc3\xa9 \"quoted\"\n\xf0\x9f\x98\x80");
+}
+
+static void test_skipped_escapes() {
+  // Escapes that can't be decoded are allowed in values that aren't used.
+  g_autoptr(UaStatus) status =
+      parse("{\"notices\": [[\"\\ud83d\", \"\\u0000\"]],"
+            "\"account\": {\"\\ude00\": \"\\ude00\\ud83d\"},"
+            "\"services\": [{\"available\": \"yes\", \"name\": \"test\","
+            "\"warning\": \"\\udead\"}]}");
+
+  g_assert_nonnull(ua_status_get_service(status, "test"));
+
+  // Values that are used must still decode.
+  assert_invalid("{\"services\": [{\"name\": \"\\u0000\"}]}");
+}
+
+static void test_unknown_values() {
+  g_autoptr(UaStatus) status =
+      parse("{\"services\": [{\"available\": \"yes\", \"name\": \"test\","
+            "\"entitled\": \"maybe\", \"status\": \"pending\"}]}");
+
+  UaService *service = ua_status_get_service(status, "test");
+  g_assert_nonnull(service);
+  g_assert_cmpstr(ua_service_get_entitled(service), ==, "maybe");
+  g_assert_cmpstr(ua_service_get_status(service), ==, "pending");
+  g_assert_cmpint(ua_service_get_entitlement(service), ==,
+                  UA_SERVICE_ENTITLEMENT_UNKNOWN);
+  g_assert_cmpint(ua_service_get_state(service), ==, UA_SERVICE_STATE_UNKNOWN);
+
+  // Services with the same values compare equal.
+  g_autoptr(UaStatus) other =
+      parse("{\"services\": [{\"available\": \"yes\", \"name\": \"test\","
+            "\"entitled\": \"maybe\", \"status\": \"pending\"}]}");
+  g_assert_true(ua_status_equal(status, other));
+}
+
+static void test_many_services() {
+  g_autoptr(UaStatusBuilder) builder = ua_status_builder_new();
+  for (guint i = 0; i < 500; i++) {
+    g_autofree gchar *name = g_strdup_printf("service-%u", i);
+    ua_status_builder_add_service(builder, name, "", "yes", "enabled");
+  }
+  g_autoptr(UaStatus) status = ua_status_builder_end(builder);
+
+  g_assert_cmpint(ua_status_get_n_services(status), ==, 500);
+  for (guint i = 0; i < 500; i++) {
+    g_autofree gchar *name = g_strdup_printf("service-%u", i);
+    UaService *service = ua_status_get_service(status, name);
+    g_assert_true(service == ua_status_get_service_by_index(status, i));
+  }
+  g_assert_null(ua_status_get_service(status, "service-500"));
+  g_assert_null(ua_status_get_service(status, ""));
+}
+
+static void test_copy() {
+  g_autoptr(UaStatusBuilder) builder = ua_status_builder_new();
+  ua_status_builder_add_service(builder, "esm-apps", "ESM Apps", "yes",
+                                "disabled");
+  ua_status_builder_add_service(builder, "livepatch", "Livepatch", "yes",
+                                "disabled");
+  g_autoptr(UaStatus) status = ua_status_builder_end(builder);
+
+  const gchar *names[] = {"esm-apps", "unknown", NULL};
+  g_autoptr(UaStatus) enabled =
+      ua_status_copy_with_service_status(status, names, "enabled");
+  g_assert_cmpint(ua_status_get_n_services(enabled), ==, 2);
+  UaService *esm_apps = ua_status_get_service(enabled, "esm-apps");
+  g_assert_cmpstr(ua_service_get_description(esm_apps), ==, "ESM Apps");
+  g_assert_cmpint(ua_service_get_state(esm_apps), ==, UA_SERVICE_STATE_ENABLED);
+  UaService *livepatch = ua_status_get_service(enabled, "livepatch");
+  g_assert_cmpint(ua_service_get_state(livepatch), ==,
+                  UA_SERVICE_STATE_DISABLED);
+
+  g_autoptr(UaStatus) attached = ua_status_copy_with_attached(status, TRUE);
+  g_assert_true(ua_status_get_attached(attached));
+  g_assert_cmpint(ua_status_get_n_services(attached), ==, 2);
+  g_assert_false(ua_status_equal(status, attached));
+}
+
+static void test_defaults() {
+  g_autoptr(UaStatus) empty = parse("{}");
+  g_assert_false(ua_status_get_attached(empty));
+  g_assert_cmpint(ua_status_get_n_services(empty), ==, 0);
+
+  g_autoptr(UaStatus) wrong_types =
+      parse("{\"attached\": \"yes\", \"services\": {\"name\": \"test\"}}");
+  g_assert_false(ua_status_get_attached(wrong_types));
+  g_assert_cmpint(ua_status_get_n_services(wrong_types), ==, 0);
+}
+
+static void test_invalid() {
+  assert_invalid("");
+  assert_invalid("[]");
+  assert_invalid("{\"attached\": tru}");
+  assert_invalid("{\"services\": [{\"name\": \"test\"}");
+  assert_invalid("{\"services\": [{\"name\": \"\\ud83d\"}]}");
+  assert_invalid("{\"notices\": \"\\ud83\"}");
+  assert_invalid("{\"name\": \"\\x\"}");
+  assert_invalid("{} {}");
+}
+
+int main(int argc, char **argv) {
+  g_test_init(&argc, &argv, NULL);
+
+  g_test_add_func("/status-parser/services", test_services);
+  g_test_add_func("/status-parser/escapes", test_escapes);
+  g_test_add_func("/status-parser/skipped-escapes", test_skipped_escapes);
+  g_test_add_func("/status-parser/unknown-values", test_unknown_values);
+  g_test_add_func("/status-parser/many-services", test_many_services);
+  g_test_add_func("/status-parser/copy", test_copy);
+  g_test_add_func("/status-parser/defaults", test_defaults);
+  g_test_add_func("/status-parser/invalid", test_invalid);
+
+  return g_test_run();
+}
@@ -0,0 +1,115 @@
+#include <gio/gio.h>
+#include <string.h>
+
+#include "test-daemon.h"
+
+#define ESM_APPS_PATH "/com/canonical/UbuntuAdvantage/Services/esm_2dapps"
+
+static GDBusConnection *daemon_connection = NULL;
+
+static void enable_cb(GObject *object, GAsyncResult *result,
+                      gpointer user_data) {
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GVariant) r =
+      g_dbus_connection_call_finish(G_DBUS_CONNECTION(object), result, &error);
+  if (r == NULL) {
+    g_warning("Failed to enable: %s\n", error->message);
+    test_daemon_failure();
+    return;
+  }
+
+  // Wait for service to change status.
+}
+
+static void get_status_cb(GObject *object, GAsyncResult *result,
+                          gpointer user_data) {
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GVariant) r =
+      g_dbus_connection_call_finish(G_DBUS_CONNECTION(object), result, &error);
+  if (r == NULL) {
+    g_warning("Failed to get service status: %s\n", error->message);
+    test_daemon_failure();
+    return;
+  }
+
+  g_autoptr(GVariant) value = NULL;
+  g_variant_get(r, "(v)", &value);
+  if (g_strcmp0(g_variant_get_string(value, NULL), "disabled") != 0) {
+    g_warning("Unexpected service status\n");
+    test_daemon_failure();
+    return;
+  }
+
+  g_dbus_connection_call(daemon_connection, "com.canonical.UbuntuAdvantage",
+                         ESM_APPS_PATH, "com.canonical.UbuntuAdvantage.Service",
+                         "Enable", g_variant_new("()"), G_VARIANT_TYPE("()"),
+                         G_DBUS_CALL_FLAGS_NONE, -1, NULL, enable_cb, NULL);
+}
+
+static void get_managed_objects_cb(GObject *object, GAsyncResult *result,
+                                   gpointer user_data) {
+  g_autoptr(GError) error = NULL;
+  g_autoptr(GVariant) r =
+      g_dbus_connection_call_finish(G_DBUS_CONNECTION(object), result, &error);
+  if (r == NULL) {
+    g_warning("Failed to get managed objects: %s\n", error->message);
+    test_daemon_failure();
+    return;
+  }
+
+  g_autoptr(GVariant) objects = g_variant_get_child_value(r, 0);
+  g_autoptr(GVariant) manager = g_variant_lookup_value(
+      objects, "/com/canonical/UbuntuAdvantage/Manager", NULL);
+  g_autoptr(GVariant) esm_apps =
+      g_variant_lookup_value(objects, ESM_APPS_PATH, NULL);
+  g_autoptr(GVariant) livepatch = g_variant_lookup_value(
+      objects, "/com/canonical/UbuntuAdvantage/Services/livepatch", NULL);
+  if (g_variant_n_children(objects) != 3 || manager == NULL ||
+      esm_apps == NULL || livepatch == NULL) {
+    g_warning("Invalid/missing managed objects\n");
+    test_daemon_failure();
+    return;
+  }
+
+  g_autoptr(GVariant) properties = g_variant_lookup_value(
+      esm_apps, "com.canonical.UbuntuAdvantage.Service", NULL);
+  const gchar *name = NULL, *status = NULL;
+  if (properties == NULL ||
+      !g_variant_lookup(properties, "Name", "&s", &name) ||
+      !g_variant_lookup(properties, "Status", "&s", &status) ||
+      g_strcmp0(name, "esm-apps") != 0 || g_strcmp0(status, "disabled") != 0) {
+    g_warning("Invalid esm-apps service properties\n");
+    test_daemon_failure();
+    return;
+  }
+
+  // Properties are also readable from the object itself.
+  g_dbus_connection_call(
+      daemon_connection, "com.canonical.UbuntuAdvantage", ESM_APPS_PATH,
+      "org.freedesktop.DBus.Properties", "Get",
+      g_variant_new("(ss)", "com.canonical.UbuntuAdvantage.Service", "Status"),
+      G_VARIANT_TYPE("(v)"), G_DBUS_CALL_FLAGS_NONE, -1, NULL, get_status_cb,
+      NULL);
+}
+
+static void daemon_ready_cb(GDBusConnection *connection) {
+  daemon_connection = connection;
+  g_dbus_connection_call(
+      connection, "com.canonical.UbuntuAdvantage", "/",
+      "org.freedesktop.DBus.ObjectManager", "GetManagedObjects",
+      g_variant_new("()"), G_VARIANT_TYPE("(a{oa{sa{sv}}})"),
+      G_DBUS_CALL_FLAGS_NONE, -1, NULL, get_managed_objects_cb, NULL);
+}
+
+static void service_status_changed_cb(const gchar *service,
+                                      const gchar *status) {
+  if (strcmp(service, "esm_2dapps") == 0 && strcmp(status, "enabled") == 0) {
+    test_daemon_success();
+  }
+}
+
+int main(int argc, char **argv) {
+  test_daemon_add_argument("--virtual-services");
+  return test_daemon_run(FALSE, FALSE, daemon_ready_cb, NULL,
+                         service_status_changed_cb);
+}